@@ -0,0 +1,36 @@
+#pragma once
+
+namespace npasm::bench {
+
+    /// Writes synthetic NanoProc programs to benchmark against.
+    ///
+    /// The programs look hand written: aligned columns, labels, trailing and
+    /// whole line comments, blank lines. Between them they use every mnemonic,
+    /// every register with each of its byte suffixes, every literal kind and
+    /// every argument form. Every label that is referenced is also defined, so
+    /// the output always parses and assembles. The same seed gives the same
+    /// program.
+    class CorpusGenerator {
+    public:
+        explicit CorpusGenerator(std::uint64_t seed = 1);
+        ~CorpusGenerator();
+
+        /// Generates a program of `lines` lines
+        std::string Generate(std::size_t lines);
+
+    private:
+        std::mt19937_64 Random;
+        std::size_t LabelCount;
+
+        /// A random number in [0, n)
+        std::size_t Pick(std::size_t n);
+
+        void AppendInstruction(std::string& out, std::size_t index);
+        void AppendArgument(std::string& out, bool allow_pointer);
+        void AppendRegister(std::string& out);
+        void AppendLiteral(std::string& out);
+        void AppendLabelName(std::string& out, std::size_t label);
+        void AppendComment(std::string& out);
+    };
+
+}
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "Opcodes.hpp"
+#include "Corpus.hpp"
+
+namespace npasm::bench {
+
+    using namespace std;
+    using namespace npasm::lexer;
+
+    namespace {
+
+        /// The byte selecting suffixes a register may carry
+        constexpr string_view RegisterSuffixes[] = {
+            "", "L", "H", "LL", "LH", "HL", "HH",
+        };
+
+        constexpr string_view CharLiterals[] = {
+            "'a'", "'Z'", "' '", "'~'", "'\\n'", "'\\t'", "'\\0'", "'\\\\'", "'\\''", "'\\x41'", "'\\x7f'", "'\\101'", "'\\377'",
+        };
+
+        constexpr string_view Comments[] = {
+            "Load the next value",
+            "Keep a copy for later",
+            "Loop until the counter runs out",
+            "Restore the saved registers",
+            "TODO: check for overflow here",
+            "Address of the frame buffer",
+            "Acknowledge the interrupt",
+        };
+
+        /// Where the mnemonic, the arguments and the trailing comment start
+        constexpr size_t MnemonicColumn = 12;
+        constexpr size_t CommentColumn = 44;
+
+        /// Every this many lines a label is defined
+        constexpr size_t LabelEvery = 8;
+
+        void PadTo(string& out, size_t line_start, size_t column) {
+            size_t used = out.length() - line_start;
+            out.append(used < column ? column - used : 1, ' ');
+        }
+
+        constexpr char Digits[] = "0123456789abcdef";
+
+        void AppendNumber(string& out, std::uint64_t value, unsigned base) {
+            char buffer[64];
+            char* end = buffer + sizeof(buffer);
+            char* p = end;
+            do {
+                *--p = Digits[value % base];
+                value /= base;
+            } while(value != 0);
+            out.append(p, end);
+        }
+
+    }
+
+    CorpusGenerator::CorpusGenerator(std::uint64_t seed) : Random{seed}, LabelCount{0} { }
+
+    CorpusGenerator::~CorpusGenerator() { }
+
+    std::size_t CorpusGenerator::Pick(std::size_t n) {
+        return static_cast<size_t>(Random() % n);
+    }
+
+    std::string CorpusGenerator::Generate(std::size_t lines) {
+        string out;
+        out.reserve(lines * 48);
+        LabelCount = max<size_t>((lines + LabelEvery - 1) / LabelEvery, 1);
+
+        size_t instruction = 0;
+        for(size_t line = 0; line < lines; line++) {
+            size_t line_start = out.length();
+
+            if(line % LabelEvery == 0) {
+                AppendLabelName(out, line / LabelEvery);
+                out += ':';
+            } else {
+                auto roll = Pick(100);
+                if(roll < 4) { // Blank line
+                    out += '\n';
+                    continue;
+                }
+                if(roll < 10) { // Comment on a line of its own, lined up with the others
+                    PadTo(out, line_start, CommentColumn);
+                    AppendComment(out);
+                    out += '\n';
+                    continue;
+                }
+            }
+
+            PadTo(out, line_start, MnemonicColumn);
+            AppendInstruction(out, instruction++);
+
+            if(Pick(100) < 60) {
+                PadTo(out, line_start, CommentColumn);
+                AppendComment(out);
+            }
+            out += '\n';
+        }
+
+        return out;
+    }
+
+    void CorpusGenerator::AppendInstruction(std::string& out, std::size_t index) {
+        // Walk the opcode table in order so every mnemonic shows up
+        auto const& info = OpcodeTable[index % OpcodeCount];
+
+        auto name = string(info.Name);
+        if(Pick(8) == 0) {
+            for(auto& c : name) {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        out += name;
+
+        if(info.HasWordSize && Pick(2) == 0) {
+            out.append(Pick(2) == 0 ? " byte" : " word");
+        }
+
+        for(size_t arg = 0; arg < info.Arity; arg++) {
+            out.append(arg == 0 ? " " : ", ");
+            AppendArgument(out, true);
+        }
+    }
+
+    void CorpusGenerator::AppendArgument(std::string& out, bool allow_pointer) {
+        auto roll = Pick(100);
+
+        if(roll < 40) {
+            AppendRegister(out);
+        } else if(roll < 65) {
+            AppendLiteral(out);
+        } else if(roll < 75) {
+            AppendLabelName(out, Pick(LabelCount));
+        } else if(roll < 90 && allow_pointer) {
+            out += '[';
+            AppendArgument(out, false);
+            out += ']';
+        } else {
+            // Indexed by X or Y, with a register or immediate offset
+            out += Pick(2) == 0 ? 'X' : 'Y';
+            out += Pick(2) == 0 ? "+ " : "- ";
+            if(Pick(2) == 0) {
+                AppendRegister(out);
+            } else {
+                AppendLiteral(out);
+            }
+        }
+    }
+
+    void CorpusGenerator::AppendRegister(std::string& out) {
+        out += '$';
+        out += RegisterNames[Pick(RegisterCount)];
+        out += RegisterSuffixes[Pick(size(RegisterSuffixes))];
+    }
+
+    void CorpusGenerator::AppendLiteral(std::string& out) {
+        switch(Pick(6)) {
+        case 0: { // Decimal, maybe signed
+            auto sign = Pick(4);
+            out += sign == 0 ? "-" : sign == 1 ? "+" : "";
+            out += static_cast<char>('1' + Pick(9));
+            AppendNumber(out, Random() % 100000, 10);
+            break;
+        }
+        case 1: // Hexadecimal
+            out += Pick(2) == 0 ? "0x" : "0X";
+            AppendNumber(out, Random() >> Pick(64), 16);
+            break;
+        case 2: // Binary
+            out += "0b";
+            AppendNumber(out, Random() & 0xffff, 2);
+            break;
+        case 3: // Octal
+            out += '0';
+            AppendNumber(out, Random() & 0xfff, 8);
+            break;
+        case 4:
+            out += CharLiterals[Pick(size(CharLiterals))];
+            break;
+        default: // Small numbers dominate real code
+            AppendNumber(out, Pick(256), 10);
+            break;
+        }
+    }
+
+    void CorpusGenerator::AppendLabelName(std::string& out, std::size_t label) {
+        out += "block_";
+        AppendNumber(out, label, 10);
+    }
+
+    void CorpusGenerator::AppendComment(std::string& out) {
+        out += "; ";
+        out += Comments[Pick(size(Comments))];
+    }
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+namespace npasm::build {
+
+    /// When a file was last written and how long it is, as cheap to get as a single stat
+    struct FileStamp {
+        std::int64_t ModifiedTime;
+        std::uint64_t Size;
+        /// When the stamp was taken, on the clock of ModifiedTime
+        std::int64_t StampedAt;
+
+        /// Whether the file was written too close to when the stamp was taken
+        ///
+        /// A write in the same tick of the file system's clock leaves the
+        /// modification time as it is, so such a stamp can't tell a later
+        /// change apart. RacyWindow is the coarsest tick of a common file
+        /// system, FAT's two seconds.
+        inline bool IsRacy() const { return ModifiedTime + RacyWindow >= StampedAt; }
+
+        /// Compares what the file was like, not when that was looked at
+        inline bool operator==(FileStamp const& other) const {
+            return ModifiedTime == other.ModifiedTime && Size == other.Size;
+        }
+
+        static const std::int64_t RacyWindow;
+    };
+
+    /// The stamp of the file at `path`, std::nullopt if it doesn't exist
+    std::optional<FileStamp> StampOf(std::string const& path);
+
+    /// What a BuildDatabase remembers about an input that was built
+    struct BuildRecord {
+        FileStamp Stamp;
+        std::uint64_t ContentHash;
+        /// A hash of everything besides the content that went into the output
+        std::uint64_t OptionsHash;
+        std::string Output;
+    };
+
+    /// Remembers which inputs were built with which options, so unchanged ones can be skipped
+    ///
+    /// An input is up to date if its output exists and it was last built to
+    /// the same output with the same options hash from the same content. The
+    /// stamp of the input is compared first, and the content is only read and
+    /// hashed when the stamp differs or was racy, so checking an unchanged
+    /// input costs two stats. An input that was touched but not changed gets
+    /// its new stamp remembered and is not hashed again next time.
+    ///
+    /// The database is one text file with a line per input, loaded whole when
+    /// the BuildDatabase is made and written back by Save, through a temporary
+    /// file that is renamed into place. Paths are escaped, so any name the file
+    /// system allows can be stored. A file that is missing, unreadable or of
+    /// another version reads as empty, which just rebuilds everything.
+    /// Checking and recording is safe from any number of threads at once.
+    class BuildDatabase {
+    public:
+        /// Changes whenever the file layout or the assembler's output does, so old records are dropped
+        static constexpr std::uint32_t FormatVersion = 2;
+
+        /// Loads the database at `path`, if there is one
+        explicit BuildDatabase(std::string path);
+        ~BuildDatabase();
+
+        /// Whether `input` was built to `output` with `options` and hasn't changed since
+        bool IsUpToDate(std::string const& input, std::string const& output, std::uint64_t options);
+
+        /// Remembers that `input`, which had `stamp` and `text` when it was read, was built
+        void Record(std::string const& input, std::string const& output, std::uint64_t options,
+            FileStamp stamp, std::string_view text);
+        /// Forgets `input`, so it is built again next time
+        void Forget(std::string const& input);
+
+        /// The record of `input`, nullptr if there is none, only valid until `input` is recorded again
+        BuildRecord const* Find(std::string const& input) const;
+        std::size_t size() const;
+
+        /// Writes the database back if anything changed, throws if it can't
+        void Save();
+
+        inline std::string const& Path() const { return File; }
+
+    private:
+        std::string File;
+        std::map<std::string, BuildRecord, std::less<>> Records;
+        mutable std::mutex Lock;
+        bool Dirty;
+
+        void Load();
+    };
+
+}
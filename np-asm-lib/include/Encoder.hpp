@@ -0,0 +1,248 @@
+#pragma once
+
+namespace npasm::encoder {
+
+    /// How instructions are laid out in a binary
+    ///
+    /// An instruction is its Opcode byte and a flags byte, then a mode byte and
+    /// an operand for each argument:
+    ///
+    /// ```
+    /// opcode | flags | mode 1 | operand 1 | mode 2 | operand 2
+    /// ```
+    ///
+    /// The low two bits of the flags are the word size: WordSizeNone if none was
+    /// given, WordSizeByte or WordSizeWord. A mode byte describes one argument:
+    ///
+    /// bits | meaning
+    /// -----|--------
+    /// 0    | the operand is an immediate rather than a register
+    /// 1    | the argument is a pointer (`[...]`)
+    /// 2-3  | it is indexed by X or Y
+    /// 4    | the index is subtracted (`X-`, `Y-`)
+    /// 5    | the immediate is relative to the end of the instruction
+    /// 6-7  | log2 of the immediate's size in bytes
+    ///
+    /// A register operand is a byte, its index in RegisterNames times eight
+    /// plus its RegisterPart. Immediates are little-endian two's complement,
+    /// one, two or four bytes long, and the shorter ones are sign-extended.
+    /// Labels are byte addresses from the start of the binary, except that the
+    /// target of a JUMP, CALL, JUMPC or CALLC naming a label directly is
+    /// relative, since most branches land close by.
+    namespace layout {
+        constexpr std::uint8_t WordSizeNone = 0;
+        constexpr std::uint8_t WordSizeByte = 1;
+        constexpr std::uint8_t WordSizeWord = 2;
+
+        constexpr std::uint8_t ModeImmediate = 0x01;
+        constexpr std::uint8_t ModePointer = 0x02;
+        constexpr std::uint8_t ModeIndexX = 0x04;
+        constexpr std::uint8_t ModeIndexY = 0x08;
+        constexpr std::uint8_t ModeIndexMinus = 0x10;
+        constexpr std::uint8_t ModeRelative = 0x20;
+        constexpr unsigned ModeSizeShift = 6;
+
+        /// The largest immediate, which any 32-bit value fits in
+        constexpr std::size_t AddressSize = 4;
+
+        /// The fewest bytes that hold `value` once sign-extended back to 32 bits
+        constexpr std::size_t ImmediateSize(std::int64_t value) {
+            if(value >= -0x80 && value < 0x80) {
+                return 1;
+            }
+            if(value >= -0x8000 && value < 0x8000) {
+                return 2;
+            }
+            return AddressSize;
+        }
+
+        /// The size bits of a mode byte for an immediate of `size` bytes
+        constexpr std::uint8_t ModeSize(std::size_t size) {
+            return static_cast<std::uint8_t>((size == 1 ? 0 : size == 2 ? 1 : 2) << ModeSizeShift);
+        }
+    }
+
+    /// Maps label names to addresses
+    ///
+    /// An open-addressing table of entry indices, with each slot keeping the
+    /// name's hash, over the entries in the order they were added. A lookup
+    /// touches one or two slots in a flat array instead of a chain of nodes.
+    class SymbolTable {
+    public:
+        struct Symbol {
+            std::string_view Name;
+            std::uint32_t Address;
+        };
+
+        /// Makes room for `count` symbols without growing
+        void Reserve(std::size_t count);
+        void Clear();
+
+        /// Adds a symbol, returns false if `name` is already there
+        bool Insert(std::string_view name, std::uint32_t address);
+        /// The address of `name`, nullptr if it isn't there
+        std::uint32_t const* Find(std::string_view name) const;
+        /// Where `name` is in Symbols(), NotFound if it isn't there
+        std::size_t IndexOf(std::string_view name) const;
+        /// Moves the symbol at `index` in Symbols()
+        inline void SetAddress(std::size_t index, std::uint32_t address) { Entries[index].Address = address; }
+
+        /// The address of `name`, throws if it isn't there
+        std::uint32_t At(std::string_view name) const;
+
+        /// The symbols in the order they were added
+        inline std::vector<Symbol> const& Symbols() const { return Entries; }
+        inline std::size_t size() const { return Entries.size(); }
+
+        static constexpr std::size_t NotFound = static_cast<std::size_t>(-1);
+
+    private:
+        struct Slot {
+            std::uint32_t Hash;
+            /// Index into Entries plus one, 0 if the slot is free
+            std::uint32_t Entry;
+        };
+
+        std::vector<Symbol> Entries;
+        std::vector<Slot> Slots;
+
+        /// Where `name` is or would go
+        std::size_t SlotOf(std::string_view name, std::uint32_t hash) const;
+        void Grow(std::size_t slots);
+    };
+
+    /// What went wrong with an instruction
+    enum class EncodeErrorCode : std::uint8_t {
+        /// An argument names a label that isn't defined anywhere
+        UndefinedLabel,
+        /// A label is defined a second time
+        DuplicateLabel,
+        /// An integer doesn't fit in 32 bits, signed or not
+        ImmediateOutOfRange,
+        /// A register name the CPU doesn't have
+        UnknownRegister,
+    };
+
+    /// An error found by the Encoder, kept as plain data until it is formatted
+    struct EncodeError {
+        EncodeErrorCode Code;
+        /// Where in the source the error is, the line's start if nothing more precise is known
+        std::uint32_t Offset;
+        /// The label or register involved
+        std::string_view Name;
+        /// The integer that is out of range
+        std::int64_t Value;
+    };
+
+    /// A four byte field of a relocatable binary that is only known once it is linked
+    ///
+    /// An absolute field becomes the label's address plus the addend, a
+    /// relative one that less the field's own address.
+    struct Relocation {
+        /// Where the field is in the binary
+        std::uint32_t Offset;
+        std::string_view Label;
+        std::int32_t Addend;
+        bool Relative;
+    };
+
+    /// The outcome of an encode, either a binary or the errors that prevent one
+    class EncodeResult {
+    public:
+        EncodeResult(std::vector<std::uint8_t> binary, SymbolTable labels, std::vector<Relocation> relocations,
+            std::vector<EncodeError> errors, lexer::SourceBuffer::sptr source, std::string file_name);
+
+        inline bool HasValue() const { return Diagnostics.empty(); }
+        inline explicit operator bool() const { return HasValue(); }
+
+        /// The binary, throws if there were errors
+        std::vector<std::uint8_t> const& Value() const;
+        /// The binary with zeros where addresses of undefined labels belong
+        inline std::vector<std::uint8_t> const& Partial() const { return Binary; }
+        /// The address of every label
+        inline SymbolTable const& Labels() const { return Addresses; }
+        /// The fields to fill in when linking, in the order of the binary, empty unless relocatable
+        inline std::vector<Relocation> const& Relocations() const { return Fields; }
+        /// The errors in source order
+        inline std::vector<EncodeError> const& Errors() const { return Diagnostics; }
+
+        /// Every error formatted as `file:line:column: error: message`, one per line
+        std::string FormatErrors() const;
+
+    private:
+        std::vector<std::uint8_t> Binary;
+        SymbolTable Addresses;
+        std::vector<Relocation> Fields;
+        std::vector<EncodeError> Diagnostics;
+        lexer::SourceBuffer::sptr Source;
+        std::string File;
+    };
+
+    /// Turns a Program into a binary in a single walk over its lines
+    ///
+    /// Integers get the shortest immediate that holds them right away. How long
+    /// an argument naming a label is depends on where the labels end up, which
+    /// depends on how long every such argument is, so the walk leaves them out
+    /// and notes each on a fixup list, with the label's position in the binary
+    /// without them. The fixups start at one byte and are relaxed: every pass
+    /// works out where the labels are with the current sizes and grows the
+    /// fixups that don't fit, until none grows. Sizes never shrink, so this
+    /// ends after a few passes, and the binary is then written out with the
+    /// fixups in their place. The AST is only visited once.
+    ///
+    /// An Encoder keeps the state of the encode in progress, so an instance
+    /// must not be shared by threads that encode at the same time.
+    class Encoder {
+    public:
+        Encoder();
+        ~Encoder();
+
+        /// Encodes `program`, as a unit of a larger program if `relocatable`
+        ///
+        /// A relocatable binary may be loaded anywhere and may name labels of
+        /// other units. Its absolute label fields always take four bytes and get
+        /// a Relocation, as does any field naming a label it doesn't define,
+        /// which is not an error then. Relative fields to its own labels don't
+        /// change when it moves, so they are still as short as they can be.
+        EncodeResult Encode(parser::Program const& program, std::string const& file_name, bool relocatable = false);
+
+    private:
+        /// An address to fill in once the labels are laid out
+        struct Fixup {
+            /// Where its mode byte is, without the fixups
+            std::uint32_t At;
+            /// Where its instruction ends, without the fixups
+            std::uint32_t End;
+            std::string_view Label;
+            /// Where the label is in Labels, SymbolTable::NotFound if it isn't defined
+            std::size_t Symbol;
+            std::int64_t Value;
+            std::uint8_t Size;
+            bool Relative;
+        };
+
+        parser::Program const* Target;
+        bool Relocatable;
+        std::vector<std::uint8_t> Binary;
+        SymbolTable Labels;
+        std::vector<Fixup> Fixups;
+        std::vector<Relocation> Relocations;
+        std::vector<EncodeError> Errors;
+
+        /// Where the labels are with the fixups at their current sizes
+        std::vector<std::uint32_t> Addresses;
+
+        void EncodeInstruction(parser::Instruction const& inst, std::uint32_t line_offset);
+        void EncodeArgument(parser::NodeRef<parser::Argument> arg, std::uint32_t line_offset, bool branch);
+        static void EmitImmediate(std::vector<std::uint8_t>& out, std::uint8_t mode, std::int64_t value, std::size_t size);
+
+        /// Grows the fixups until they all fit
+        void Relax();
+        /// The binary with every fixup in place, noting the Relocations of a relocatable one
+        std::vector<std::uint8_t> Emit();
+
+        /// Where `text`, which points into the Program's source, starts
+        std::uint32_t OffsetOf(std::string_view text) const;
+    };
+
+}
@@ -3,59 +3,155 @@
 namespace npasm::lexer {
 
     /// Tokenizes a string of source code.
+    ///
+    /// Lexing takes time linear in the length of the source, whatever it holds.
+    /// A scan either consumes what it reads or gives up after a few bytes. The
+    /// one exception is the blanks between an identifier and a possible label
+    /// colon, which are read twice. Bytes that can't start a token are skipped
+    /// in a single pass.
+    ///
+    /// A Lexer keeps the file name and line of the lex in progress, so an
+    /// instance must not be shared by threads that lex at the same time.
+    /// Separate instances share nothing mutable and may run on any number of
+    /// threads. A returned TokenStream is never modified by the Lexer again
+    /// (Relex aside) and may be read from any thread.
     class Lexer {
     public:
         Lexer();
         ~Lexer();
 
         //using MaybeStr = std::optional<std::string>;
-        std::vector<TokenPtr> LexFile(std::string const& str);
-        std::vector<TokenPtr> LexString(std::string const& str);
-
-        TokenPtr IsNEWLINE(std::string const& str);
-        TokenPtr IsCOLON(std::string const& str);
-        TokenPtr IsSEMICOLON(std::string const& str);
-        TokenPtr IsNON_NEWLINE(std::string const& str);
-        TokenPtr IsMNEMONIC(std::string const& str);
-        TokenPtr IsWORD_SIZE(std::string const& str);
-        TokenPtr IsCOMMA(std::string const& str);
-        TokenPtr IsREGISTER(std::string const& str);
-        TokenPtr IsBINARY_DIGIT(std::string const& str);
-        TokenPtr IsOCTAL_DIGIT(std::string const& str);
-        TokenPtr IsDECIMAL_DIGIT(std::string const& str);
-        TokenPtr IsHEX_DIGIT(std::string const& str);
-        TokenPtr IsLEFT_BRACKET(std::string const& str);
-        TokenPtr IsRIGHT_BRACKET(std::string const& str);
-        TokenPtr IsXPLUS(std::string const& str);
-        TokenPtr IsXMINUS(std::string const& str);
-        TokenPtr IsYPLUS(std::string const& str);
-        TokenPtr IsYMINUS(std::string const& str);
-        TokenPtr IsSIMPLE_CHAR(std::string const& str);
-        TokenPtr IsESCAPED_CONTROL_CHAR(std::string const& str);
-        TokenPtr IsESCAPED_OCTAL_CHAR(std::string const& str);
-        TokenPtr IsESCAPED_HEX_CHAR(std::string const& str);
-
-        TokenPtr IsIDENTIFIER(std::string const& str);
-        TokenPtr IsLABEL(std::string const& str);
-        TokenPtr IsCOMMENT(std::string const& str);
-
-        TokenPtr IsBINARY_LITERAL(std::string const& str);
-        TokenPtr IsOCTAL_LITERAL(std::string const& str);
-        TokenPtr IsDECIMAL_LITERAL(std::string const& str);
-        TokenPtr IsHEX_LITERAL(std::string const& str);
-
-        TokenPtr IsCHAR_LITERAL(std::string const& str);
-
-        size_t SkipWhitespace(std::string const& str);
-        std::int64_t FromBinary(std::string const& str);
-        std::int64_t FromOctal(std::string const& str);
-        std::int64_t FromHex(std::string const& str);
+        TokenStream LexFile(std::string const& str);
+
+        /// Lexes a file on up to `threads` threads (0 for one per core)
+        ///
+        /// No token spans a newline, so the file is cut at line boundaries into
+        /// pieces of at least MinParallelChunk bytes that are lexed on their own
+        /// and joined. The result is the same as the single threaded LexFile.
+        TokenStream LexFile(std::string const& str, std::size_t threads);
+        TokenStream LexString(std::string_view str);
+
+        /// Lexes a file of `sources` on up to `threads` threads, like LexFile
+        ///
+        /// The tokens know their SourceLocations and keep the file's buffer alive
+        /// even if `sources` goes away first.
+        TokenStream Lex(SourceManager const& sources, FileId file, std::size_t threads = 1);
+
+        /// Starts lexing `source` a few lines at a time with LexLines
+        ///
+        /// \returns An empty TokenStream over the source for LexLines to fill
+        TokenStream BeginLines(std::string const& file_name, SourceBuffer::sptr source);
+        /// Like BeginLines, for a file of `sources`, so the tokens know their SourceLocations
+        TokenStream BeginLines(SourceManager const& sources, FileId file);
+
+        /// Replaces what `tokens` holds with the tokens of the whole lines from
+        /// `offset` on, at least `bytes` of them up to the end of the source
+        ///
+        /// The tokens keep their offsets into the whole source, so their text,
+        /// lines and locations are the same as when the file is lexed at once.
+        /// Only the lines of one call are held at a time, and `tokens` reuses
+        /// its storage from call to call.
+        ///
+        /// \returns The offset of the next line, the length of the source after the last one
+        std::size_t LexLines(TokenStream& tokens, std::size_t offset, std::size_t bytes = 1);
+
+        /// Updates `tokens` for an edit that replaces `length` bytes at `offset`
+        /// of their source with `replacement`
+        ///
+        /// Only the lines touched by the edit are lexed again and spliced in,
+        /// the tokens after them are moved lazily (see TokenStream). Apart from
+        /// the first edit of a stream, the time taken depends on the size of
+        /// the edit and its distance from the last one, not on the size of the
+        /// source. The result is the same as lexing the edited source anew.
+        void Relex(TokenStream& tokens, std::size_t offset, std::size_t length, std::string_view replacement);
+
+        TokenPtr IsNEWLINE(std::string_view str);
+        TokenPtr IsCOLON(std::string_view str);
+        TokenPtr IsSEMICOLON(std::string_view str);
+        TokenPtr IsNON_NEWLINE(std::string_view str);
+        TokenPtr IsMNEMONIC(std::string_view str);
+        TokenPtr IsWORD_SIZE(std::string_view str);
+        TokenPtr IsCOMMA(std::string_view str);
+        TokenPtr IsREGISTER(std::string_view str);
+        TokenPtr IsBINARY_DIGIT(std::string_view str);
+        TokenPtr IsOCTAL_DIGIT(std::string_view str);
+        TokenPtr IsDECIMAL_DIGIT(std::string_view str);
+        TokenPtr IsHEX_DIGIT(std::string_view str);
+        TokenPtr IsLEFT_BRACKET(std::string_view str);
+        TokenPtr IsRIGHT_BRACKET(std::string_view str);
+        TokenPtr IsXPLUS(std::string_view str);
+        TokenPtr IsXMINUS(std::string_view str);
+        TokenPtr IsYPLUS(std::string_view str);
+        TokenPtr IsYMINUS(std::string_view str);
+        TokenPtr IsSIMPLE_CHAR(std::string_view str);
+        TokenPtr IsESCAPED_CONTROL_CHAR(std::string_view str);
+        TokenPtr IsESCAPED_OCTAL_CHAR(std::string_view str);
+        TokenPtr IsESCAPED_HEX_CHAR(std::string_view str);
+
+        TokenPtr IsIDENTIFIER(std::string_view str);
+        TokenPtr IsLABEL(std::string_view str);
+        TokenPtr IsCOMMENT(std::string_view str);
+
+        TokenPtr IsBINARY_LITERAL(std::string_view str);
+        TokenPtr IsOCTAL_LITERAL(std::string_view str);
+        TokenPtr IsDECIMAL_LITERAL(std::string_view str);
+        TokenPtr IsHEX_LITERAL(std::string_view str);
+
+        TokenPtr IsCHAR_LITERAL(std::string_view str);
+
+        size_t SkipWhitespace(std::string_view str);
+        /// Converts digits of a base into their 64 bit pattern
+        ///
+        /// Throws if `str` is empty, holds anything but digits of the base or
+        /// needs more than 64 bits.
+        std::int64_t FromBinary(std::string_view str);
+        std::int64_t FromOctal(std::string_view str);
+        std::int64_t FromHex(std::string_view str);
+
+        /// The smallest piece of a file LexFile will give a thread of its own
+        static constexpr std::size_t MinParallelChunk = 64 * 1024;
 
     private:
+        friend class TokenReader;
+
+        /// The result of scanning a single token from the source
+        struct Lexeme {
+            TokenType Type;
+            /// How many characters of the source were consumed, 0 if nothing was recognized
+            std::size_t Length;
+            /// Where the token's text (register name, label name, comment body) starts, relative to the token
+            std::size_t TextOffset;
+            /// How long the token's text is
+            std::size_t TextLength;
+            /// The value of a literal
+            std::int64_t Value;
+        };
+
         std::string FileName;
-        std::size_t CurrentLine;
+        /// The line the text being lexed starts on
+        std::uint32_t FirstLine;
+
+        void LexStringIntern(std::string_view str, TokenStream& tokens, std::size_t start_idx = 0);
+        void LexParallel(TokenStream& tokens, std::size_t threads);
+        void Emit(TokenStream& tokens, std::size_t idx, Lexeme const& lex);
+
+        /// Recognizes the token starting at `idx` with a single dispatch on its first character
+        Lexeme ScanLexeme(std::string_view str, std::size_t idx);
+        Lexeme ScanWord(std::string_view str, std::size_t idx);
+        Lexeme ScanIdentifier(std::string_view str, std::size_t idx);
+        Lexeme ScanLabel(std::string_view str, std::size_t idx, Lexeme const& ident);
+        Lexeme ScanComment(std::string_view str, std::size_t idx);
+        Lexeme ScanRegister(std::string_view str, std::size_t idx);
+        Lexeme ScanNumber(std::string_view str, std::size_t idx);
+        Lexeme ScanCharLiteral(std::string_view str, std::size_t idx);
+
+        /// Reads the digits of a binary, octal or hex literal as a 64 bit pattern
+        std::int64_t ScanBits(std::string_view str, std::size_t idx, std::size_t digits, std::size_t end, int base);
+        /// Reports a literal whose value doesn't fit as `file:line:column: error: ...`, counting from 1
+        [[noreturn]] void ThrowOutOfRange(std::string_view str, std::size_t idx, std::size_t length) const;
+        std::int64_t FromBase(std::string_view str, int base, char const* what);
 
-        std::vector<TokenPtr> LexStringIntern(std::string const& str);
+        TokenPtr MakeToken(std::string_view str, std::size_t idx, Lexeme const& lex);
     };
 
     /// Converts a list of Tokens into a debug string
@@ -2,242 +2,206 @@
 
 namespace npasm::parser {
 
-    /// The base node for the abstract syntax tree generated by the Parser
-    class ASTNode {
-    public:
-        using sptr = std::shared_ptr<ASTNode>;
+    /// Refers to a node of type T by its index in the Program's pool of T
+    template <class T>
+    struct NodeRef {
+        static constexpr std::uint32_t None = std::numeric_limits<std::uint32_t>::max();
 
-        inline ASTNode() = default;
-        inline virtual ~ASTNode() { }
+        std::uint32_t Index = None;
+
+        inline bool IsValid() const { return Index != None; }
+        inline explicit operator bool() const { return IsValid(); }
     };
 
-    /// A generic base class for all derived ASTNode types
+    /// Append-only storage for the nodes of one type
     ///
-    /// \tparam T The derived ASTNode type
+    /// Nodes are plain values that own nothing, so a pool is freed in one go
+    /// without visiting them.
     template <class T>
-    class BaseASTNode : public ASTNode {
-    public:
-        using sptr = std::shared_ptr<T>;
+    class Pool {
+        static_assert(std::is_trivially_destructible_v<T>, "Pooled nodes must not own anything");
 
-        inline BaseASTNode() : ASTNode() { }
-        inline virtual ~BaseASTNode() { }
-    };
-
-    /// Represents a label (`label_name:`)
-    class Label : public BaseASTNode<Label> {
     public:
+        inline NodeRef<T> Add(T const& node) {
+            Nodes.push_back(node);
+            return { static_cast<std::uint32_t>(Nodes.size() - 1) };
+        }
 
-        /// The string representing the label name
-        std::string Value;
+        inline T& operator[](NodeRef<T> ref) { return Nodes[ref.Index]; }
+        inline T const& operator[](NodeRef<T> ref) const { return Nodes[ref.Index]; }
+        inline T& operator[](std::size_t idx) { return Nodes[idx]; }
+        inline T const& operator[](std::size_t idx) const { return Nodes[idx]; }
 
-        inline Label() : BaseASTNode() { }
-        inline Label(std::string const& ident) :
-            BaseASTNode(), Value{ident} {}
+        inline std::size_t size() const { return Nodes.size(); }
+        inline bool empty() const { return Nodes.empty(); }
+        inline auto begin() const { return Nodes.begin(); }
+        inline auto end() const { return Nodes.end(); }
 
-        inline virtual ~Label() { }
-    };
+        inline void Reserve(std::size_t count) { Nodes.reserve(count); }
+        /// Grows or shrinks to `count` nodes, so that several threads can fill disjoint parts
+        inline void Resize(std::size_t count) { Nodes.resize(count); }
+        /// Drops the nodes added after the first `count`
+        inline void Truncate(std::size_t count) { Nodes.erase(Nodes.begin() + count, Nodes.end()); }
 
-    /// Represents a mnemonic (`MOVE`, `PUSH`, `JUMP`, etc.)
-    class Mnemonic : public BaseASTNode<Mnemonic> {
-    public:
-        std::string Value;
-
-        inline Mnemonic() : BaseASTNode() { }
-        inline Mnemonic(std::string const& value) :
-            BaseASTNode(), Value{value} {}
-
-        inline virtual ~Mnemonic() { }
+    private:
+        std::vector<T> Nodes;
     };
 
-    /// Represents a word size (`word` or `byte`)
-    class WordSize : public BaseASTNode<WordSize> {
-    public:
-        std::string Value;
-
-        inline WordSize() : BaseASTNode() { }
-        inline WordSize(std::string const& value) :
-            BaseASTNode(), Value{value} {}
+    /// Represents a label (`label_name:`)
+    struct Label {
+        std::string_view Value;
+    };
 
-        inline virtual ~WordSize() { }
+    /// Represents a comment (`; This is a comment`), without the semicolon
+    struct Comment {
+        std::string_view Value;
     };
 
-    /// Represents a full instruction (`MOVE $ACC, 123`)
-    class Instruction : public BaseASTNode<Instruction> {
-    public:
-        Mnemonic::sptr Mnemonic;
-        WordSize::sptr WordSize;
+    struct RegisterArgument;
+    struct IntegerArgument;
+    struct IdentifierArgument;
+    struct PointerArgument;
+    struct XIndexArgument;
+    struct YIndexArgument;
 
-        inline Instruction() : BaseASTNode() { }
-        inline Instruction(Mnemonic::sptr mnemonic, WordSize::sptr word_size) :
-            BaseASTNode(), Mnemonic{mnemonic}, WordSize{word_size} { }
-        inline virtual ~Instruction() { }
-    };
+    /// Any argument to an instruction
+    ///
+    /// The set of kinds is closed, consumers handle all of them with a single
+    /// std::visit instead of probing the kinds one at a time.
+    using Argument = std::variant<
+        RegisterArgument,
+        IntegerArgument,
+        IdentifierArgument,
+        PointerArgument,
+        XIndexArgument,
+        YIndexArgument
+    >;
 
-    /// Represents an instruction that takes no arguments (`NOP` or `POP word`)
-    class NoArgumentInstruction : public BaseASTNode<NoArgumentInstruction>, public Instruction {
-    public:
-        using sptr = BaseASTNode<NoArgumentInstruction>::sptr;
+    /// Represents a register argument (`$ACC`, `$Al`, `$Blh`)
+    struct RegisterArgument {
+        std::string_view Value;
+    };
 
-        inline NoArgumentInstruction() : Instruction(), BaseASTNode<NoArgumentInstruction>() { }
-        inline NoArgumentInstruction(Mnemonic::sptr mnemonic, WordSize::sptr word_size) :
-            Instruction(mnemonic, word_size), BaseASTNode<NoArgumentInstruction>() {}
-        inline virtual ~NoArgumentInstruction() { }
+    /// Represents an integer argument (`123`, `0765`, `0xFEDC`, `-0b0101`, `'a'`)
+    struct IntegerArgument {
+        std::int64_t Value;
     };
 
-    /// Represents some argument to an instruction.
-    class Argument : public BaseASTNode<Argument> {
-    public:
-        inline Argument() : BaseASTNode() { }
-        inline virtual ~Argument() { }
+    /// Represents an identifier argument (`label_name`)
+    struct IdentifierArgument {
+        std::string_view Value;
     };
 
     /// Represents a pointer argument (`[123]`, `[$SP]`, `[some_label]`, `[X+123]`)
-    class PointerArgument : public BaseASTNode<PointerArgument>, public Argument {
-    public:
-        using sptr = BaseASTNode<PointerArgument>::sptr;
-        Argument::sptr SubArgument;
-
-        inline PointerArgument() : Argument(), BaseASTNode<PointerArgument>() { }
-        inline PointerArgument(Argument::sptr sub_arg) :
-            Argument(), BaseASTNode<PointerArgument>(),
-            SubArgument{sub_arg} {}
-        inline virtual ~PointerArgument() { }
+    struct PointerArgument {
+        NodeRef<Argument> SubArgument;
     };
 
     /// Represents a X-indexed argument (`X+123`, `X-$ACC`)
-    class XIndexArgument : public BaseASTNode<XIndexArgument>, public Argument {
-    public:
-        using sptr = BaseASTNode<XIndexArgument>::sptr;
+    struct XIndexArgument {
         bool Plus;
-        Argument::sptr SubArgument;
-
-        inline XIndexArgument() : Argument(), BaseASTNode<XIndexArgument>() { }
-        inline XIndexArgument(bool plus, Argument::sptr sub_arg) :
-            Argument(), BaseASTNode<XIndexArgument>(),
-            Plus{plus}, SubArgument{sub_arg} {}
-        inline virtual ~XIndexArgument() { }
+        NodeRef<Argument> SubArgument;
     };
 
     /// Represents a Y-indexed argument (`Y+123`, `Y-$ACC`)
-    class YIndexArgument : public BaseASTNode<YIndexArgument>, public Argument {
-    public:
-        using sptr = BaseASTNode<YIndexArgument>::sptr;
+    struct YIndexArgument {
         bool Plus;
-        Argument::sptr SubArgument;
-
-        inline YIndexArgument() : Argument(), BaseASTNode<YIndexArgument>() { }
-        inline YIndexArgument(bool plus, Argument::sptr sub_arg) :
-            Argument(), BaseASTNode<YIndexArgument>(),
-            Plus{plus}, SubArgument{sub_arg} {}
-        inline virtual ~YIndexArgument() { }
-    };
-
-    /// Represents a register argument (`$ACC`, `$Al`, `$Blh`)
-    class RegisterArgument : public BaseASTNode<RegisterArgument>, public Argument {
-    public:
-        using sptr = BaseASTNode<RegisterArgument>::sptr;
-        std::string Value;
-
-        inline RegisterArgument() : Argument(), BaseASTNode<RegisterArgument>() { }
-        inline RegisterArgument(std::string const& value) :
-            Argument(), BaseASTNode<RegisterArgument>(),
-            Value{value} {}
-        inline virtual ~RegisterArgument() { }
-    };
-
-    /// Represents an immediate argument (`label_name`, `123`, `-0xFE`, `'a'`)
-    class ImmediateArgument : public BaseASTNode<ImmediateArgument>, public Argument {
-    public:
-        using sptr = BaseASTNode<ImmediateArgument>::sptr;
-        inline ImmediateArgument() : Argument(), BaseASTNode<ImmediateArgument>() { }
-        inline virtual ~ImmediateArgument() { }
-    };
-
-    /// Represents an integer argument (`123`, `0765`, `0xFEDC`, `-0b0101`, `'a'`)
-    class IntegerArgument : public BaseASTNode<IntegerArgument>, public ImmediateArgument {
-    public:
-        using sptr = BaseASTNode<IntegerArgument>::sptr;
-        std::int64_t Value;
-
-        inline IntegerArgument() : ImmediateArgument(), BaseASTNode<IntegerArgument>() { }
-        inline IntegerArgument(std::int64_t value) :
-            ImmediateArgument(), BaseASTNode<IntegerArgument>(),
-            Value{value} {}
-        inline virtual ~IntegerArgument() { }
+        NodeRef<Argument> SubArgument;
     };
 
-    /// Represents an identifier argument (`label_name`)
-    class IdentifierArgument : public BaseASTNode<IdentifierArgument>, public ImmediateArgument {
-    public:
-        using sptr = BaseASTNode<IdentifierArgument>::sptr;
-        std::string Value;
-
-        inline IdentifierArgument() : ImmediateArgument(), BaseASTNode<IdentifierArgument>() { }
-        inline IdentifierArgument(std::string const& value) :
-            ImmediateArgument(), BaseASTNode<IdentifierArgument>(),
-            Value{value} {}
-        inline virtual ~IdentifierArgument() { }
-    };
-
-    /// Represents a single-argument instruction (`PUSH word $Ah`)
-    class OneArgumentInstruction : public BaseASTNode<OneArgumentInstruction>, public Instruction {
-    public:
-        using sptr = BaseASTNode<OneArgumentInstruction>::sptr;
-        Argument::sptr Argument;
-
-        inline OneArgumentInstruction() : Instruction(), BaseASTNode<OneArgumentInstruction>() { }
-        inline OneArgumentInstruction(Mnemonic::sptr mnemonic, WordSize::sptr word_size, Argument::sptr arg) :
-            Instruction(mnemonic, word_size), BaseASTNode<OneArgumentInstruction>(),
-            Argument{arg} { }
-        inline virtual ~OneArgumentInstruction() { }
-    };
-
-    /// Represents a two-argument instruction (`MOVE $ACC, 123`)
-    class TwoArgumentInstruction : public BaseASTNode<TwoArgumentInstruction>, public Instruction {
-    public:
-        using sptr = BaseASTNode<TwoArgumentInstruction>::sptr;
-        Argument::sptr Argument1;
-        Argument::sptr Argument2;
-
-        inline TwoArgumentInstruction() : Instruction(), BaseASTNode<TwoArgumentInstruction>() { }
-        inline TwoArgumentInstruction(Mnemonic::sptr mnemonic, WordSize::sptr word_size, Argument::sptr arg1, Argument::sptr arg2) :
-            Instruction(mnemonic, word_size), BaseASTNode<TwoArgumentInstruction>(),
-            Argument1{arg1}, Argument2{arg2} { }
-        inline virtual ~TwoArgumentInstruction() { }
+    /// Builds a visitor for std::visit out of one lambda per node type
+    template <class... Funcs>
+    struct Overloaded : Funcs... {
+        using Funcs::operator()...;
     };
+    template <class... Funcs>
+    Overloaded(Funcs...) -> Overloaded<Funcs...>;
 
-    /// Represents a comment (`; This is a comment`)
-    class Comment : public BaseASTNode<Comment> {
-    public:
-        std::string Value;
-
-        inline Comment() : BaseASTNode() { }
-        inline Comment(std::string const& value) :
-            BaseASTNode(), Value{value} { }
-        inline virtual ~Comment() { }
+    /// Represents a full instruction (`MOVE $ACC, 123`, `POP word`, `NOP`)
+    struct Instruction {
+        lexer::Opcode Mnemonic;
+        /// `word` or `byte` as written, empty if not given
+        std::string_view WordSize;
+        std::uint8_t ArgumentCount;
+        NodeRef<Argument> Arguments[2];
     };
 
     /// Represents a full line of code (`label_name: MOVE word $Al, [X+123] ; Comment`)
-    class Line : public BaseASTNode<Line> {
-    public:
-        Label::sptr Label;
-        Instruction::sptr Instruction;
-        Comment::sptr Comment;
-
-        inline Line() : BaseASTNode() { }
-        inline Line(Label::sptr label, Instruction::sptr instruction, Comment::sptr comment) :
-            Label{label}, Instruction{instruction}, Comment{comment} {}
-        inline virtual ~Line() { }
+    struct Line {
+        NodeRef<parser::Label> Label;
+        NodeRef<parser::Instruction> Instruction;
+        NodeRef<parser::Comment> Comment;
+        /// Where the line's first token is in the source
+        std::uint32_t Offset;
     };
 
     /// Represents a full program
-    class Program : public BaseASTNode<Program> {
-    public:
-        std::vector<Line::sptr> Lines;
-
-        inline Program() :
-            BaseASTNode(), Lines{} {}
-        inline virtual ~Program() { }
+    ///
+    /// Every node lives in the pool for its type and refers to others by 32-bit
+    /// index. Strings point into the source text, which the Program keeps alive.
+    /// Building a Program costs a few growing arrays instead of an allocation
+    /// per node, and freeing it releases those arrays in O(1).
+    class Program {
+    public:
+        using sptr = std::shared_ptr<Program>;
+
+        /// The lines in source order
+        Pool<Line> Lines;
+        Pool<Label> Labels;
+        Pool<Instruction> Instructions;
+        Pool<Comment> Comments;
+        Pool<Argument> Arguments;
+
+        /// The text the nodes' strings point into
+        lexer::SourceBuffer::sptr Source;
+
+        /// How many nodes each pool holds
+        struct Extent {
+            std::size_t Lines;
+            std::size_t Labels;
+            std::size_t Instructions;
+            std::size_t Comments;
+            std::size_t Arguments;
+        };
+
+        inline Extent Size() const {
+            return { Lines.size(), Labels.size(), Instructions.size(), Comments.size(), Arguments.size() };
+        }
+
+        /// Drops every node added since Size() returned `extent`, so a failed parse leaves nothing behind
+        ///
+        /// Nothing that stays may refer to the dropped nodes.
+        inline void Truncate(Extent const& extent) {
+            Lines.Truncate(extent.Lines);
+            Labels.Truncate(extent.Labels);
+            Instructions.Truncate(extent.Instructions);
+            Comments.Truncate(extent.Comments);
+            Arguments.Truncate(extent.Arguments);
+        }
+
+        template <class T>
+        inline NodeRef<T> Add(T const& node) { return PoolOf<T>().Add(node); }
+
+        template <class T>
+        inline T& operator[](NodeRef<T> ref) { return PoolOf<T>()[ref]; }
+        template <class T>
+        inline T const& operator[](NodeRef<T> ref) const { return const_cast<Program*>(this)->PoolOf<T>()[ref]; }
+
+        /// The argument `ref` refers to if it is a T, otherwise nullptr
+        template <class T>
+        inline T const* As(NodeRef<Argument> ref) const {
+            return ref.IsValid() ? std::get_if<T>(&Arguments[ref]) : nullptr;
+        }
+
+    private:
+        template <class T>
+        inline Pool<T>& PoolOf() {
+            if constexpr(std::is_same_v<T, Line>) return Lines;
+            else if constexpr(std::is_same_v<T, Label>) return Labels;
+            else if constexpr(std::is_same_v<T, Instruction>) return Instructions;
+            else if constexpr(std::is_same_v<T, Comment>) return Comments;
+            else return Arguments;
+        }
     };
 
 }
@@ -0,0 +1,155 @@
+#pragma once
+
+namespace npasm::object {
+
+    /// How a NanoProc object file is laid out
+    ///
+    /// An object file is a fixed header followed by three tables of fixed-size
+    /// records, a string table and the contents of the sections:
+    ///
+    /// ```
+    /// ObjectHeader | SectionHeader... | SymbolEntry... | RelocationEntry... | names | section data...
+    /// ```
+    ///
+    /// Every integer is little-endian and every record and table starts at a
+    /// multiple of 8 bytes into the file, so a mapping of the file can be used
+    /// as arrays of these structs as it is. Names are referred to by offset and
+    /// length into the string table and are also followed by a NUL byte.
+    namespace layout {
+        constexpr char Magic[4] = { 'N', 'P', 'O', 'B' };
+
+        /// Changes whenever the layout does, readers reject other versions
+        constexpr std::uint16_t FormatVersion = 1;
+
+        /// What every table, name table and section starts on
+        constexpr std::size_t Alignment = 8;
+
+        /// The Section of a symbol that another unit defines
+        constexpr std::uint32_t UndefinedSection = std::numeric_limits<std::uint32_t>::max();
+
+        /// A section holds instructions
+        constexpr std::uint32_t SectionCode = 0x1;
+
+        struct ObjectHeader {
+            char Magic[4];
+            std::uint16_t Version;
+            std::uint16_t HeaderSize;
+            std::uint32_t SectionCount;
+            std::uint32_t SymbolCount;
+            std::uint32_t RelocationCount;
+            /// Names are referred to by 32-bit offsets, so their table is no larger
+            std::uint32_t StringTableSize;
+            /// Where the tables are in the file
+            std::uint64_t SectionTable;
+            std::uint64_t SymbolTable;
+            std::uint64_t RelocationTable;
+            std::uint64_t StringTable;
+            /// The size of the whole file, which tells a truncated one apart
+            std::uint64_t FileSize;
+        };
+
+        /// A name in the string table
+        struct NameRef {
+            std::uint32_t Offset;
+            std::uint32_t Length;
+        };
+
+        struct SectionHeader {
+            NameRef Name;
+            /// SectionCode or other Section flags
+            std::uint32_t Flags;
+            /// What the section's load address must be a multiple of
+            std::uint32_t Alignment;
+            /// Where the contents are in the file
+            std::uint64_t Offset;
+            std::uint64_t Size;
+        };
+
+        struct SymbolEntry {
+            NameRef Name;
+            /// The index of the section the symbol is in, UndefinedSection if another unit defines it
+            std::uint32_t Section;
+            /// How far into its section the symbol is
+            std::uint32_t Value;
+        };
+
+        enum class RelocationKind : std::uint8_t {
+            /// The field becomes the symbol's address plus the addend
+            Absolute32,
+            /// The field becomes the symbol's address plus the addend less the field's own address
+            Relative32,
+        };
+
+        struct RelocationEntry {
+            /// The index of the section the field is in
+            std::uint32_t Section;
+            /// Where the field is in its section
+            std::uint32_t Offset;
+            std::uint32_t Symbol;
+            std::int32_t Addend;
+            RelocationKind Kind;
+            std::uint8_t Reserved[7];
+        };
+
+        /// How many bytes a relocated field takes
+        constexpr std::uint32_t RelocationFieldSize = 4;
+
+        static_assert(sizeof(ObjectHeader) == 64 && sizeof(SectionHeader) == 32 &&
+            sizeof(SymbolEntry) == 16 && sizeof(RelocationEntry) == 24, "The records have a fixed layout");
+        static_assert(std::endian::native == std::endian::little, "Object files are used in place, so the host must be little-endian");
+    }
+
+    /// Lays out the binary of a relocatable EncodeResult as an object file
+    ///
+    /// The binary becomes one code section called `code`. Every label is a
+    /// symbol in it, followed by the labels of other units that relocations
+    /// name, in the order they are first named.
+    std::vector<std::uint8_t> BuildObject(encoder::EncodeResult const& result);
+
+    /// An object file in memory, read through views into its bytes
+    ///
+    /// Opening one checks the header, that every table and section lies within
+    /// the file and that every symbol and relocated field lies within its
+    /// section, so the views can be handed out without any further work.
+    /// Nothing is copied and nothing is allocated per record, a file is mapped
+    /// once and its tables are used where they lie.
+    ///
+    /// Symbol indices and names inside records are checked when they are looked
+    /// up through the ObjectFile, not when it is opened.
+    class ObjectFile {
+    public:
+        /// Maps the file at `path`, throws if it can't be read or isn't a valid object file
+        static ObjectFile FromFile(std::string const& path);
+        /// Uses `buffer`, which must start on an 8-byte boundary, throws if it isn't a valid object file
+        explicit ObjectFile(lexer::SourceBuffer::sptr buffer);
+
+        inline layout::ObjectHeader const& Header() const { return *At<layout::ObjectHeader>(0); }
+        inline std::span<layout::SectionHeader const> Sections() const { return SectionRecords; }
+        inline std::span<layout::SymbolEntry const> Symbols() const { return SymbolRecords; }
+        inline std::span<layout::RelocationEntry const> Relocations() const { return RelocationRecords; }
+
+        /// A name from the string table, throws if it lies outside of it
+        std::string_view Name(layout::NameRef name) const;
+        /// The contents of a section
+        std::span<std::uint8_t const> Data(layout::SectionHeader const& section) const;
+
+        /// The symbol a relocation names, throws if there is no such symbol
+        layout::SymbolEntry const& SymbolOf(layout::RelocationEntry const& relocation) const;
+        /// The symbol called `name`, nullptr if there is none, looking through every symbol
+        layout::SymbolEntry const* FindSymbol(std::string_view name) const;
+
+    private:
+        lexer::SourceBuffer::sptr Buffer;
+        std::span<layout::SectionHeader const> SectionRecords;
+        std::span<layout::SymbolEntry const> SymbolRecords;
+        std::span<layout::RelocationEntry const> RelocationRecords;
+        std::string_view Strings;
+
+        template<typename T>
+        inline T const* At(std::uint64_t offset) const { return reinterpret_cast<T const*>(Buffer->Text().data() + offset); }
+        /// The `count` records of type T at `offset`, throws if they don't fit in the file
+        template<typename T>
+        std::span<T const> Table(std::uint64_t offset, std::uint64_t count) const;
+    };
+
+}
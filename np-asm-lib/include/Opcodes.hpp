@@ -0,0 +1,291 @@
+#pragma once
+
+namespace npasm::lexer {
+
+    /// Identifies an instruction mnemonic
+    enum class Opcode : std::uint8_t {
+        NOP,
+        MOVE,
+        SWAP,
+        ADD,
+        SUB,
+        INC,
+        DEC,
+        MULS,
+        MUL,
+        DIVS,
+        DIV,
+        MODS,
+        MOD,
+        AND,
+        BOR,
+        XOR,
+        SHRA,
+        SHR,
+        SHL,
+        CMPZ,
+        CMPNZ,
+        CMPEQ,
+        CMPNE,
+        CMPGTS,
+        CMPLTS,
+        CMPGES,
+        CMPLES,
+        CMPGT,
+        CMPLT,
+        CMPGE,
+        CMPLE,
+        STACK,
+        PUSH,
+        POP,
+        JUMPC,
+        CALLC,
+        JUMP,
+        CALL,
+        RET,
+        INT,
+        IRET,
+        IQE,
+        IQD,
+        ISET,
+        IRSET,
+        ION,
+        IOFF,
+        HWIN,
+        HWOUT,
+        HWNUM,
+        HWQRY,
+        HWINT,
+        HALT,
+    };
+
+    /// Describes how an instruction is written
+    struct OpcodeInfo {
+        Opcode Id;
+        /// The canonical (upper case) spelling of the mnemonic
+        std::string_view Name;
+        /// How many arguments the instruction takes
+        std::uint8_t Arity;
+        /// Whether the instruction may be given a WordSize (`byte` or `word`)
+        bool HasWordSize;
+    };
+
+    /// Every opcode, indexed by its Opcode value
+    constexpr OpcodeInfo OpcodeTable[] = {
+        { Opcode::NOP,    "NOP",    0, false },
+        { Opcode::MOVE,   "MOVE",   2, true  },
+        { Opcode::SWAP,   "SWAP",   2, true  },
+        { Opcode::ADD,    "ADD",    2, true  },
+        { Opcode::SUB,    "SUB",    2, true  },
+        { Opcode::INC,    "INC",    1, true  },
+        { Opcode::DEC,    "DEC",    1, true  },
+        { Opcode::MULS,   "MULS",   2, true  },
+        { Opcode::MUL,    "MUL",    2, true  },
+        { Opcode::DIVS,   "DIVS",   2, true  },
+        { Opcode::DIV,    "DIV",    2, true  },
+        { Opcode::MODS,   "MODS",   2, true  },
+        { Opcode::MOD,    "MOD",    2, true  },
+        { Opcode::AND,    "AND",    2, true  },
+        { Opcode::BOR,    "BOR",    2, true  },
+        { Opcode::XOR,    "XOR",    2, true  },
+        { Opcode::SHRA,   "SHRA",   2, true  },
+        { Opcode::SHR,    "SHR",    2, true  },
+        { Opcode::SHL,    "SHL",    2, true  },
+        { Opcode::CMPZ,   "CMPZ",   1, true  },
+        { Opcode::CMPNZ,  "CMPNZ",  1, true  },
+        { Opcode::CMPEQ,  "CMPEQ",  2, true  },
+        { Opcode::CMPNE,  "CMPNE",  2, true  },
+        { Opcode::CMPGTS, "CMPGTS", 2, true  },
+        { Opcode::CMPLTS, "CMPLTS", 2, true  },
+        { Opcode::CMPGES, "CMPGES", 2, true  },
+        { Opcode::CMPLES, "CMPLES", 2, true  },
+        { Opcode::CMPGT,  "CMPGT",  2, true  },
+        { Opcode::CMPLT,  "CMPLT",  2, true  },
+        { Opcode::CMPGE,  "CMPGE",  2, true  },
+        { Opcode::CMPLE,  "CMPLE",  2, true  },
+        { Opcode::STACK,  "STACK",  1, true  },
+        { Opcode::PUSH,   "PUSH",   1, true  },
+        { Opcode::POP,    "POP",    0, true  },
+        { Opcode::JUMPC,  "JUMPC",  1, false },
+        { Opcode::CALLC,  "CALLC",  1, false },
+        { Opcode::JUMP,   "JUMP",   1, false },
+        { Opcode::CALL,   "CALL",   1, false },
+        { Opcode::RET,    "RET",    0, false },
+        { Opcode::INT,    "INT",    1, true  },
+        { Opcode::IRET,   "IRET",   0, false },
+        { Opcode::IQE,    "IQE",    0, false },
+        { Opcode::IQD,    "IQD",    0, false },
+        { Opcode::ISET,   "ISET",   2, true  },
+        { Opcode::IRSET,  "IRSET",  1, true  },
+        { Opcode::ION,    "ION",    0, false },
+        { Opcode::IOFF,   "IOFF",   0, false },
+        { Opcode::HWIN,   "HWIN",   2, true  },
+        { Opcode::HWOUT,  "HWOUT",  2, true  },
+        { Opcode::HWNUM,  "HWNUM",  1, true  },
+        { Opcode::HWQRY,  "HWQRY",  1, false },
+        { Opcode::HWINT,  "HWINT",  1, true  },
+        { Opcode::HALT,   "HALT",   0, false },
+    };
+
+    /// The number of opcodes
+    constexpr std::size_t OpcodeCount = std::size(OpcodeTable);
+
+    /// Gets the descriptor for an opcode
+    constexpr OpcodeInfo const& GetOpcodeInfo(Opcode op) {
+        return OpcodeTable[static_cast<std::size_t>(op)];
+    }
+
+    namespace detail {
+
+        /// The multiplier of the mnemonic hash, chosen so that no two mnemonics share a slot
+        constexpr std::uint32_t OpcodeHashFactor = 207;
+
+        /// How many slots the mnemonic hash table has
+        constexpr std::size_t OpcodeHashSlots = 256;
+
+        /// Marks an empty slot in the mnemonic hash table
+        constexpr std::uint8_t NoOpcode = 0xff;
+
+        constexpr std::size_t MinMnemonicLength = 3;
+        constexpr std::size_t MaxMnemonicLength = 6;
+
+        /// Hashes a mnemonic, ignoring ASCII letter case
+        constexpr std::size_t HashMnemonic(std::string_view word) {
+            std::uint32_t hash = 0;
+            for(char c : word) {
+                hash = hash * OpcodeHashFactor + static_cast<std::uint8_t>(c | 0x20);
+            }
+            return static_cast<std::uint32_t>(hash * 2654435761u) >> 24;
+        }
+
+        constexpr std::array<std::uint8_t, OpcodeHashSlots> MakeOpcodeSlots() {
+            std::array<std::uint8_t, OpcodeHashSlots> slots{};
+            for(auto& slot : slots) {
+                slot = NoOpcode;
+            }
+            for(std::size_t i = 0; i < OpcodeCount; i++) {
+                slots[HashMnemonic(OpcodeTable[i].Name)] = static_cast<std::uint8_t>(i);
+            }
+            return slots;
+        }
+
+        /// Maps a mnemonic hash to the index of its OpcodeTable entry
+        constexpr auto OpcodeSlots = MakeOpcodeSlots();
+
+        constexpr bool OpcodeTableIsValid() {
+            for(std::size_t i = 0; i < OpcodeCount; i++) {
+                auto const& info = OpcodeTable[i];
+                if(static_cast<std::size_t>(info.Id) != i ||
+                    OpcodeSlots[HashMnemonic(info.Name)] != i ||
+                    info.Name.length() < MinMnemonicLength ||
+                    info.Name.length() > MaxMnemonicLength) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static_assert(OpcodeTableIsValid(), "OpcodeTable is out of order or the mnemonic hash is no longer perfect");
+
+    }
+
+    /// Finds the Opcode for a mnemonic, ignoring ASCII letter case
+    ///
+    /// \returns The Opcode, or `std::nullopt` if `word` is not a mnemonic
+    constexpr std::optional<Opcode> FindOpcode(std::string_view word) {
+        if(word.length() < detail::MinMnemonicLength || word.length() > detail::MaxMnemonicLength) {
+            return std::nullopt;
+        }
+
+        auto slot = detail::OpcodeSlots[detail::HashMnemonic(word)];
+        if(slot == detail::NoOpcode) {
+            return std::nullopt;
+        }
+
+        auto const& info = OpcodeTable[slot];
+        if(info.Name.length() != word.length()) {
+            return std::nullopt;
+        }
+        for(std::size_t i = 0; i < word.length(); i++) {
+            char c = word[i];
+            if(c >= 'a' && c <= 'z') {
+                c = static_cast<char>(c - 'a' + 'A');
+            }
+            if(c != info.Name[i]) {
+                return std::nullopt;
+            }
+        }
+        return info.Id;
+    }
+
+    /// Every register, as written after the `$`
+    ///
+    /// Order matters, the first matching prefix wins (`INTQ` before `INT`). A
+    /// register is encoded as its index here.
+    constexpr std::string_view RegisterNames[] = {
+        "ACC", "COMP", "EXC", "INTQ", "INT", "ION", "STL", "SP", "PC",
+        "A", "B", "C", "D", "E", "F", "G", "H", "X", "Y",
+    };
+
+    /// The number of registers
+    constexpr std::size_t RegisterCount = std::size(RegisterNames);
+
+    /// Which part of a register is used, selected by up to two `l`/`h` suffixes (`$Al`, `$Blh`)
+    enum class RegisterPart : std::uint8_t {
+        Full,
+        L,
+        H,
+        LL,
+        LH,
+        HL,
+        HH,
+    };
+
+    /// Identifies a register or a part of it
+    struct RegisterId {
+        /// Index into RegisterNames
+        std::uint8_t Index;
+        RegisterPart Part;
+    };
+
+    /// Finds a register as written after the `$`, ignoring ASCII letter case
+    ///
+    /// \returns The register, or `std::nullopt` if `name` is not one
+    constexpr std::optional<RegisterId> FindRegister(std::string_view name) {
+        auto upper = [](char c) { return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c; };
+
+        for(std::size_t idx = 0; idx < RegisterCount; idx++) {
+            auto const& base = RegisterNames[idx];
+            if(name.length() < base.length() || upper(name[0]) != base[0]) {
+                continue;
+            }
+            bool matches = true;
+            for(std::size_t i = 0; i < base.length() && matches; i++) {
+                matches = upper(name[i]) == base[i];
+            }
+            if(!matches) {
+                continue;
+            }
+
+            auto suffix = name.substr(base.length());
+            std::uint8_t part = 0;
+            for(char c : suffix) {
+                if(upper(c) != 'L' && upper(c) != 'H') {
+                    return std::nullopt;
+                }
+                part = static_cast<std::uint8_t>(part * 2 + (upper(c) == 'L' ? 1 : 2));
+            }
+            if(suffix.length() > 2) {
+                return std::nullopt;
+            }
+            return RegisterId{ static_cast<std::uint8_t>(idx), static_cast<RegisterPart>(part) };
+        }
+        return std::nullopt;
+    }
+
+    /// Writes the canonical spelling of an Opcode
+    inline std::ostream& operator<<(std::ostream& os, Opcode op) {
+        return os << GetOpcodeInfo(op).Name;
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+namespace npasm::optimizer {
+
+    /// A rewrite the Optimizer makes
+    enum class PeepholeRule : std::uint8_t {
+        /// `MOVE $r, a` is dropped when the next instruction is a `MOVE $r, b` that doesn't read `$r`
+        DeadMove,
+        /// A run of `INC $r` becomes one `ADD $r, n`, and a run of `DEC $r` one `SUB $r, n`
+        IncChain,
+        /// `PUSH a` is dropped together with a `POP` of the same size right after it
+        PushPop,
+        /// A `JUMP` or `JUMPC` to the next instruction is dropped
+        JumpToNext,
+    };
+
+    /// The number of rules
+    constexpr std::size_t PeepholeRuleCount = 4;
+
+    /// The name of a rule as written in reports (`dead-move`)
+    std::string_view ToString(PeepholeRule rule);
+
+    /// Rewrites redundant instruction patterns in a parsed Program
+    ///
+    /// A single walk over the lines looks at each instruction together with
+    /// the ones before it, back to the last label. A labelled line may be
+    /// jumped to, so no rewrite joins instructions across one. Dropping an
+    /// instruction only clears its line's Instruction, the line keeps its
+    /// label and comment, so labels and diagnostics stay where they were.
+    ///
+    /// The rules only touch the general purpose registers (`$ACC`, `$A` to
+    /// `$H`, `$X` and `$Y`), since writes to the others have side effects.
+    /// Like the Encoder, an instance keeps its counters and scratch space, so
+    /// it must not be shared by threads that optimize at the same time.
+    class Optimizer {
+    public:
+        /// Rewrites `program` in place, returns how many rewrites were made
+        std::size_t Optimize(parser::Program& program);
+
+        /// How many times `rule` was applied by this Optimizer so far
+        inline std::size_t Hits(PeepholeRule rule) const { return Counters[static_cast<std::size_t>(rule)]; }
+
+    private:
+        /// What a rule did to a pair of neighbouring instructions
+        enum class Outcome {
+            None,
+            DroppedPrevious,
+            DroppedCurrent,
+            DroppedBoth,
+        };
+
+        std::array<std::size_t, PeepholeRuleCount> Counters{};
+        /// The rewrites made by the Optimize in progress
+        std::size_t Rewrites = 0;
+        /// The lines holding the instructions since the last label
+        std::vector<std::size_t> Run;
+
+        Outcome Combine(parser::Program& program, parser::Line& previous, parser::Line& current);
+        bool JumpsToNext(parser::Program const& program, std::size_t line) const;
+        inline void Hit(PeepholeRule rule) {
+            Counters[static_cast<std::size_t>(rule)]++;
+            Rewrites++;
+        }
+    };
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+namespace npasm {
+
+    /// Calls `func(0)` through `func(count - 1)` on up to `threads` threads and
+    /// rethrows the first exception any of them threw
+    ///
+    /// Each thread claims the next index as soon as it is done with its last
+    /// one, so with more indices than threads a thread that got easy pieces
+    /// takes over the work a slow one hasn't started yet. Once a call has
+    /// thrown, the indices nobody has claimed yet are skipped.
+    template<typename Func>
+    void ParallelFor(std::size_t count, std::size_t threads, Func const& func) {
+        std::atomic<std::size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr first;
+        auto work = [&]() {
+            for(std::size_t idx; !failed.load() && (idx = next.fetch_add(1)) < count;) {
+                try {
+                    func(idx);
+                } catch(...) {
+                    // Only the thread that flips the flag writes `first`, and it is read after they are all joined
+                    bool expected = false;
+                    if(failed.compare_exchange_strong(expected, true)) {
+                        first = std::current_exception();
+                    }
+                }
+            }
+        };
+
+        std::vector<std::future<void>> pending;
+        for(std::size_t i = 1; i < std::min(threads, count); i++) {
+            pending.push_back(std::async(std::launch::async, work));
+        }
+        work();
+        for(auto& task : pending) {
+            task.get();
+        }
+        if(first) {
+            std::rethrow_exception(first);
+        }
+    }
+
+}
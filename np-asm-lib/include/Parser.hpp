@@ -2,40 +2,166 @@
 
 namespace npasm::parser {
 
+    /// What went wrong on a line
+    enum class DiagnosticCode : std::uint8_t {
+        /// The token isn't one of the Expected ones
+        UnexpectedToken,
+        /// A word size was given to an instruction that doesn't take one
+        WordSizeNotAllowed,
+        /// A pointer was given as the address of a pointer
+        NestedPointer,
+    };
+
+    /// An error found by the Parser, kept as plain data until it is formatted
+    struct Diagnostic {
+        DiagnosticCode Code;
+        /// 0-based line and column of the offending token
+        std::uint32_t Line;
+        std::uint32_t Column;
+        /// Byte offset of the offending token in the source
+        std::uint32_t Offset;
+        /// Invalid unless the tokens were lexed from a SourceManager
+        lexer::SourceLocation Location;
+        /// The offending token, empty at the end of the input
+        std::optional<lexer::TokenType> Found;
+        /// One bit per TokenType that would have been accepted instead
+        std::uint64_t Expected;
+        /// The instruction a WordSizeNotAllowed is about
+        lexer::Opcode Mnemonic;
+
+        inline bool Expects(lexer::TokenType type) const {
+            return (Expected >> static_cast<unsigned>(type)) & 1;
+        }
+    };
+
+    /// Formats a Diagnostic as `file:line:column: error: message`, counting from 1 like SourceManager::ToString
+    std::string ToString(Diagnostic const& diagnostic, std::string_view file_name);
+
+    /// The outcome of a parse, either a Program or the errors that prevent one
+    ///
+    /// Parsing carries on past a bad line, so the Program is still available as
+    /// Partial() with every line that did parse.
+    class ParseResult {
+    public:
+        ParseResult(Program::sptr program, std::vector<Diagnostic> errors, std::string file_name);
+
+        inline bool HasValue() const { return Diagnostics.empty(); }
+        inline explicit operator bool() const { return HasValue(); }
+
+        /// The Program, throws if there were errors
+        Program::sptr const& Value() const;
+        /// The Program without the lines that had errors
+        inline Program::sptr const& Partial() const { return Result; }
+        /// The errors in source order
+        inline std::vector<Diagnostic> const& Errors() const { return Diagnostics; }
+        inline std::string const& FileName() const { return File; }
+
+        /// Every error formatted, one per line
+        std::string FormatErrors() const;
+
+    private:
+        Program::sptr Result;
+        std::vector<Diagnostic> Diagnostics;
+        std::string File;
+    };
+
     /// Parses a list of Tokens into a syntax tree
+    ///
+    /// A Parser only keeps the furthest failure and the Program of the parse in
+    /// progress, so an instance must not be shared by threads that parse at the
+    /// same time. A parse on several threads gives each its own Parser. Any
+    /// number of Parsers may run at once, even over the same TokenStream, since
+    /// the tokens are only read.
     class Parser {
     public:
         Parser();
         ~Parser();
 
-        using TokenList = std::vector<lexer::TokenPtr>;
+        using TokenList = lexer::TokenStream;
 
         template<class T>
-        using ParseReturn = std::tuple<T, TokenList::const_iterator>;
-
-        Program::sptr Parse(TokenList const& tokens);
-
-        Program::sptr ParseProgram(TokenList const& tokens);
-        ParseReturn<Line::sptr> ParseLine(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<Label::sptr> ParseLabel(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<Instruction::sptr> ParseInstruction(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<Comment::sptr> ParseComment(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<TwoArgumentInstruction::sptr> ParseTwoArgumentInstruction(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<OneArgumentInstruction::sptr> ParseOneArgumentInstruction(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<IdentifierArgument::sptr> ParseIdentifierArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<IntegerArgument::sptr> ParseIntegerArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<ImmediateArgument::sptr> ParseImmediateArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<RegisterArgument::sptr> ParseRegisterArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<YIndexArgument::sptr> ParseYIndexArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<XIndexArgument::sptr> ParseXIndexArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<PointerArgument::sptr> PointerArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<Argument::sptr> ParseArgument(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<NoArgumentInstruction::sptr> ParseNoArgumentInstruction(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<WordSize::sptr> ParseWordSize(TokenList const& tokens, TokenList::const_iterator cpos);
-        ParseReturn<Mnemonic::sptr> ParseMnemonic(TokenList const& tokens, TokenList::const_iterator cpos);
+        using ParseReturn = std::tuple<T, std::size_t>;
+
+        /// Parses every line on up to `threads` threads (0 for one per core) and
+        /// reports all errors instead of throwing
+        ///
+        /// Lines don't depend on each other, so the tokens are cut after NEWLINEs
+        /// into pieces of at least MinParallelTokens that are parsed on their
+        /// own. The pieces are joined in order, so the Program and the errors are
+        /// the same as with a single thread.
+        ParseResult TryParse(TokenList const& tokens, std::size_t threads = 1);
+        /// Like TryParse, but throws with every error formatted if there are any
+        Program::sptr Parse(TokenList const& tokens, std::size_t threads = 1);
+
+        /// Lexes and parses `source` a few lines at a time, without a TokenStream of the whole file
+        ///
+        /// `lexer` hands over the tokens of FusedBatchBytes worth of whole lines
+        /// and the Parser adds those lines to the Program before asking for the
+        /// next. Token memory stays at a batch or the longest line instead of
+        /// growing with the file. The result is the same as
+        /// TryParse(lexer.LexString(...)), and lexer errors throw as they do there.
+        ParseResult ParseFused(lexer::Lexer& lexer, std::string const& file_name, lexer::SourceBuffer::sptr source);
+        /// Like ParseFused, for a file of `sources`, so the errors know their SourceLocations
+        ParseResult ParseFused(lexer::Lexer& lexer, lexer::SourceManager const& sources, lexer::FileId file);
+
+        /// How much source ParseFused lexes at a time, enough to make the cost of a call vanish
+        static constexpr std::size_t FusedBatchBytes = 4 * 1024;
+
+        /// The fewest tokens worth parsing on a thread of their own
+        static constexpr std::size_t MinParallelTokens = 16 * 1024;
+        /// How many pieces each thread gets on average, so that threads done early can take over
+        static constexpr std::size_t PiecesPerThread = 4;
+
+        ParseResult ParseProgram(TokenList const& tokens, std::size_t threads = 1);
+        ParseReturn<NodeRef<Line>> ParseLine(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Label>> ParseLabel(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Instruction>> ParseInstruction(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Comment>> ParseComment(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Instruction>> ParseTwoArgumentInstruction(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Instruction>> ParseOneArgumentInstruction(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseIdentifierArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseIntegerArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseImmediateArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseRegisterArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseYIndexArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseXIndexArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParsePointerArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Argument>> ParseArgument(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<NodeRef<Instruction>> ParseNoArgumentInstruction(std::size_t cpos);
+        /// The word size as written, empty if there is none
+        ParseReturn<std::string_view> ParseWordSize(TokenList const& tokens, std::size_t cpos);
+        ParseReturn<std::optional<lexer::Opcode>> ParseMnemonic(TokenList const& tokens, std::size_t cpos);
         
     private:
-        std::string LastError;
+        /// The furthest point a speculative parse of the current line got to
+        ///
+        /// Failed attempts only record where they stopped and what they wanted
+        /// there, the Diagnostic is built once the whole line has failed.
+        struct Failure {
+            std::size_t Position;
+            DiagnosticCode Code;
+            std::uint64_t Expected;
+            lexer::Opcode Mnemonic;
+        };
+
+        /// Records that a token of `type` would have been accepted at `cpos`
+        void Expect(std::size_t cpos, lexer::TokenType type);
+        /// Records an error other than an unexpected token at `cpos`
+        void Reject(std::size_t cpos, DiagnosticCode code, lexer::Opcode mnemonic = {});
+        Diagnostic MakeDiagnostic(TokenList const& tokens) const;
+        ParseResult ParseFused(lexer::Lexer& lexer, lexer::TokenStream& window);
+        /// Sizes the pools of `program` for roughly `tokens` tokens
+        static void Reserve(Program& program, std::size_t tokens);
+        /// Parses the lines in [first, last) into `program`, `last` must follow a NEWLINE or be the end
+        void ParseLines(TokenList const& tokens, std::size_t first, std::size_t last, Program& program,
+            std::vector<Diagnostic>& errors);
+
+        Failure Furthest;
+        /// The Program being built, whose pools the Parse functions add to
+        Program* Target;
     };
 
+    /// Converts a Program back into source code, one line per Line
+    std::string ToString(Program const& program);
+
 }
@@ -0,0 +1,31 @@
+#pragma once
+
+namespace npasm::lexer::simd {
+
+    /// Instruction sets the scanning kernels can use, from slowest to fastest
+    enum class SimdLevel : std::uint8_t {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    /// The fastest level the running CPU supports, detected once
+    SimdLevel DetectedLevel();
+
+    /// Finds the first byte at or after `idx` that is not non-newline whitespace
+    ///
+    /// \returns Its index, or `str.length()` if the rest of `str` is blank
+    std::size_t SkipBlanks(std::string_view str, std::size_t idx);
+
+    /// Finds the first `'\n'` at or after `idx`
+    ///
+    /// \returns Its index, or `str.length()` if there is none
+    std::size_t FindNewline(std::string_view str, std::size_t idx);
+
+    /// SkipBlanks using a specific level, which must not exceed DetectedLevel()
+    std::size_t SkipBlanks(std::string_view str, std::size_t idx, SimdLevel level);
+
+    /// FindNewline using a specific level, which must not exceed DetectedLevel()
+    std::size_t FindNewline(std::string_view str, std::size_t idx, SimdLevel level);
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+namespace npasm::lexer {
+
+    /// Holds the text of a source file.
+    ///
+    /// Regular files are memory mapped and lexed in place. Anything that can't
+    /// be mapped (pipes, character devices, empty files) is read into memory
+    /// instead. Either way the text stays valid for as long as the buffer lives.
+    class SourceBuffer {
+    public:
+        using sptr = std::shared_ptr<SourceBuffer const>;
+
+        SourceBuffer(SourceBuffer const&) = delete;
+        SourceBuffer& operator=(SourceBuffer const&) = delete;
+        ~SourceBuffer();
+
+        /// Makes a buffer holding a copy of `text`
+        static sptr FromString(std::string_view text);
+
+        /// Makes a buffer that takes ownership of `text`
+        static sptr Adopt(std::string&& text);
+
+        /// Maps or reads the file at `path`, throws if it can't be opened or a read fails
+        static sptr FromFile(std::string const& path);
+
+        /// The source text
+        inline std::string_view Text() const { return View; }
+
+        /// Whether the text is a memory mapping of the file
+        inline bool IsMapped() const { return Mapping != nullptr; }
+
+        /// The zero based line `offset` is on
+        ///
+        /// The first call indexes every newline in the text, later calls are a
+        /// binary search. Safe to call from several threads at once.
+        std::uint32_t LineOf(std::size_t offset) const;
+
+        /// The offset of the first byte of `line`
+        std::size_t LineStart(std::uint32_t line) const;
+
+        /// How many lines the text has, counting the possibly empty one after the last newline
+        std::size_t LineCount() const;
+
+    private:
+        SourceBuffer();
+
+        std::string Owned;
+        void* Mapping;
+        std::size_t MappingSize;
+        std::string_view View;
+
+        mutable std::once_flag LineIndexOnce;
+        /// Where each line starts, built on first use
+        mutable std::vector<std::uint32_t> LineStarts;
+
+        std::vector<std::uint32_t> const& LineIndex() const;
+    };
+
+    /// A fast 64-bit hash of `text` that tells file contents apart, it is not meant to resist attacks
+    std::uint64_t HashText(std::string_view text);
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+namespace npasm::lexer {
+
+    /// Identifies a file added to a SourceManager
+    using FileId = std::uint32_t;
+
+    /// A byte position in one of the files of a SourceManager, packed into 32 bits.
+    ///
+    /// Every file gets its own range of one shared 32-bit space, so a location
+    /// encodes both the file and the offset into it. The default location is
+    /// invalid and belongs to no file.
+    class SourceLocation {
+    public:
+        constexpr SourceLocation() : Raw{0} { }
+
+        static constexpr SourceLocation FromRaw(std::uint32_t raw) { return SourceLocation{raw}; }
+
+        inline constexpr std::uint32_t GetRaw() const { return Raw; }
+        inline constexpr bool IsValid() const { return Raw != 0; }
+
+        /// The location `delta` bytes further into the same file
+        inline constexpr SourceLocation operator+(std::uint32_t delta) const { return SourceLocation{Raw + delta}; }
+
+        inline constexpr bool operator==(SourceLocation other) const { return Raw == other.Raw; }
+        inline constexpr bool operator!=(SourceLocation other) const { return Raw != other.Raw; }
+        inline constexpr bool operator<(SourceLocation other) const { return Raw < other.Raw; }
+
+    private:
+        constexpr explicit SourceLocation(std::uint32_t raw) : Raw{raw} { }
+
+        std::uint32_t Raw;
+    };
+
+    /// Owns the source files of an assembly and maps SourceLocations back to them.
+    ///
+    /// Lines and columns are never stored, they are worked out from each file's
+    /// newline index when asked for. Like TokenStream lines they count from zero,
+    /// only ToString counts from one.
+    ///
+    /// Adding files must not race with anything else, looking locations up is
+    /// safe from any number of threads.
+    class SourceManager {
+    public:
+        /// Returned for locations that belong to no file
+        static constexpr FileId InvalidFile = std::numeric_limits<FileId>::max();
+
+        /// A location spelled out for people
+        struct LineColumn {
+            std::string_view FileName;
+            std::uint32_t Line;
+            std::uint32_t Column;
+        };
+
+        SourceManager();
+        SourceManager(SourceManager const&) = delete;
+        SourceManager& operator=(SourceManager const&) = delete;
+        ~SourceManager();
+
+        /// Maps or reads the file at `path`, throws if it can't be opened
+        FileId AddFile(std::string const& path);
+
+        /// Adds text that is already in memory under the name `name`
+        ///
+        /// Throws once the files no longer fit into the 32-bit location space.
+        FileId AddBuffer(std::string const& name, SourceBuffer::sptr buffer);
+
+        inline std::size_t FileCount() const { return Files.size(); }
+
+        std::string const& FileName(FileId file) const;
+        SourceBuffer::sptr const& Buffer(FileId file) const;
+
+        /// The location of byte `offset` of `file`, which may be one past its end
+        SourceLocation Location(FileId file, std::uint32_t offset) const;
+
+        /// The file a location is in, or InvalidFile
+        FileId FileOf(SourceLocation loc) const;
+
+        /// How far into its file a location is
+        std::uint32_t OffsetOf(SourceLocation loc) const;
+
+        std::uint32_t Line(SourceLocation loc) const;
+        std::uint32_t Column(SourceLocation loc) const;
+        LineColumn Resolve(SourceLocation loc) const;
+
+        /// Formats a location as `file:line:column`, counting lines and columns from 1 for people
+        std::string ToString(SourceLocation loc) const;
+
+    private:
+        struct Entry {
+            std::string Name;
+            SourceBuffer::sptr Buffer;
+            /// The raw location of the first byte
+            std::uint32_t Base;
+        };
+
+        std::vector<Entry> Files;
+        /// Where the next file's range starts, zero stays the invalid location
+        std::uint64_t NextBase;
+    };
+
+}
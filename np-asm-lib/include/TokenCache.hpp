@@ -0,0 +1,50 @@
+#pragma once
+
+namespace npasm::lexer {
+
+    /// Keeps lexed files in a directory, keyed by a hash of their content
+    ///
+    /// Each entry is the TokenStream's arrays behind a fixed header, laid out
+    /// so that they are naturally aligned in a mapping of the file. A hit maps
+    /// the entry and copies the arrays out instead of lexing, which only costs
+    /// the hash of the source and the entry, a memcpy per array and a bounds
+    /// check per token. Files that are shared by many programs, such as a
+    /// routine library, are lexed once per content.
+    ///
+    /// Entries are written to a temporary file and renamed into place, so any
+    /// number of TokenCaches and processes may share a directory. An entry that
+    /// is missing, stale, damaged or unreadable is a miss and is written anew.
+    /// The header holds a hash of the arrays, and every type, payload and span
+    /// is checked against the source, so a damaged entry never reaches past it.
+    class TokenCache {
+    public:
+        /// Changes whenever the lexer or the entry layout does, so old entries miss
+        static constexpr std::uint32_t FormatVersion = 2;
+
+        /// Uses `directory`, creating it if needed
+        explicit TokenCache(std::string const& directory);
+        ~TokenCache();
+
+        /// Lexes `file` of `sources`, or loads its tokens if the same content was lexed before
+        ///
+        /// The result is the same as `lexer.Lex(sources, file)`. Safe to call
+        /// from several threads at once with a Lexer each.
+        TokenStream Lex(Lexer& lexer, SourceManager const& sources, FileId file);
+
+        /// Where the entry for a source with this text lives
+        std::string PathFor(std::string_view text) const;
+
+        inline std::size_t Hits() const { return HitCount; }
+        inline std::size_t Misses() const { return MissCount; }
+
+    private:
+        std::string Directory;
+        std::atomic<std::size_t> HitCount;
+        std::atomic<std::size_t> MissCount;
+
+        /// Fills `tokens` from the entry at `path`, returns false if it doesn't match `text`
+        bool Load(std::string const& path, std::string_view text, std::uint64_t hash, TokenStream& tokens) const;
+        void Store(std::string const& path, std::uint64_t hash, TokenStream const& tokens) const;
+    };
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+namespace npasm::lexer {
+
+    /// Lexes a stream of source code on demand.
+    ///
+    /// Input is read `chunk_size` bytes at a time. Every token ends before the
+    /// next newline, so only whole lines are lexed and a partial line at the end
+    /// of a chunk is carried over until the rest of it arrives. Memory use stays
+    /// around one chunk plus the longest line, however long the input is.
+    ///
+    /// ```
+    /// auto reader = TokenReader(std::cin, "<stdin>");
+    /// while(reader.Next()) {
+    ///     if(reader.Type() == TokenType::MNEMONIC) { ... }
+    /// }
+    /// ```
+    class TokenReader {
+    public:
+        /// How many bytes are read from the input at a time by default
+        static constexpr std::size_t DefaultChunkSize = 64 * 1024;
+
+        /// Reads from `input`, which must outlive the reader
+        TokenReader(std::istream& input, std::string const& file_name, std::size_t chunk_size = DefaultChunkSize);
+        ~TokenReader();
+
+        /// Moves to the next token
+        ///
+        /// \returns false once the input is exhausted
+        bool Next();
+
+        inline TokenType Type() const { return Window.Type(Pos); }
+        inline std::uint32_t Length() const { return Window.Length(Pos); }
+        inline std::uint32_t Line() const { return Window.Line(Pos); }
+        inline Opcode GetOpcode() const { return Window.GetOpcode(Pos); }
+        inline std::int64_t Value() const { return Window.Value(Pos); }
+
+        /// The offset of the current token from the start of the input
+        inline std::uint64_t Offset() const { return WindowOffset + Window.Offset(Pos); }
+
+        /// The text of the current token, valid until the reader moves past its line
+        inline std::string_view Text() const { return Window.Text(Pos); }
+
+        /// Builds a Token object for the current token
+        inline TokenPtr ToToken() const { return Window.ToToken(Pos); }
+
+        /// The lines lexed by the last read, the current token is at `Index()`
+        inline TokenStream const& Tokens() const { return Window; }
+        inline std::size_t Index() const { return Pos; }
+
+    private:
+        std::istream& Input;
+        std::size_t ChunkSize;
+        Lexer Lex;
+
+        /// Input read but not lexed yet: a partial last line
+        std::string Pending;
+        bool AtEnd;
+
+        TokenStream Window;
+        std::uint64_t WindowOffset;
+        /// The line the window starts on
+        std::uint32_t WindowLine;
+        std::size_t Pos;
+
+        /// Reads up to the next complete line(s) and lexes them into Window
+        ///
+        /// \returns false if there is nothing left to read
+        bool Refill();
+    };
+
+}
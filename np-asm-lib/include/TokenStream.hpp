@@ -0,0 +1,222 @@
+#pragma once
+
+namespace npasm::lexer {
+
+    /// A flat list of tokens stored as parallel arrays.
+    ///
+    /// Each token costs a type byte, its source offset and length, and a payload
+    /// word. Lines aren't stored, they are looked up in the source's newline index
+    /// when asked for. What the payload means depends on the type:
+    ///
+    /// - `MNEMONIC`: the Opcode
+    /// - `CHAR_LITERAL`: the character
+    /// - the other literals: an index into the literal values
+    /// - `IDENTIFIER`, `LABEL`, `REGISTER`, `WORD_SIZE`, `COMMENT`: an index into the text spans
+    ///
+    /// Text is never copied out of the source, which the stream keeps alive. Token
+    /// objects and their debug strings are only built on request.
+    ///
+    /// A stream can be edited in place, see EditSource and Splice. The first
+    /// edit copies the source and its newline index into the stream, where
+    /// they and the token arrays are kept with a gap at the last edit. Later
+    /// edits cost time in proportion to their size and their distance from
+    /// the one before, the tokens, lines and text past the gap are only moved
+    /// when the gap moves over them and their offsets are stored relative to a
+    /// shift that every edit adds its length change to.
+    class TokenStream {
+    public:
+        /// A range of the source text
+        struct Span {
+            std::uint32_t Offset;
+            std::uint32_t Length;
+        };
+
+        TokenStream();
+        /// Tokens of `source`, whose first byte is on line `first_line` and, if
+        /// the source is a file of a SourceManager, at location `origin`
+        TokenStream(std::string const& file_name, SourceBuffer::sptr source, std::uint32_t first_line = 0, SourceLocation origin = {});
+        ~TokenStream();
+
+        inline std::size_t size() const { return Types.size() - GapSize; }
+        inline bool empty() const { return size() == 0; }
+
+        inline TokenType Type(std::size_t idx) const { return Types[At(idx)]; }
+        inline std::uint32_t Offset(std::size_t idx) const { return Offsets[At(idx)] + ShiftOf(idx); }
+        inline std::uint32_t Length(std::size_t idx) const { return Lengths[At(idx)]; }
+        std::uint32_t Line(std::size_t idx) const;
+
+        /// Where a token is in its SourceManager, invalid if the source isn't in one
+        inline SourceLocation Location(std::size_t idx) const { return Origin.IsValid() ? Origin + Offset(idx) : SourceLocation{}; }
+
+        /// The Opcode of a `MNEMONIC` token
+        inline Opcode GetOpcode(std::size_t idx) const { return static_cast<Opcode>(Payloads[At(idx)]); }
+
+        /// The value of a literal token (including `CHAR_LITERAL`)
+        std::int64_t Value(std::size_t idx) const;
+
+        /// The text of a token: the name for identifiers, labels and registers, the
+        /// body for comments, otherwise everything the token consumed
+        std::string_view Text(std::size_t idx) const;
+
+        /// The name of the file the tokens came from
+        inline std::string const& FileName() const { return File; }
+
+        /// The full source text the tokens refer to
+        ///
+        /// After an edit the text is joined into a new buffer on the first call.
+        std::string_view Source() const;
+        /// The length of the source text, without joining an edited one
+        std::size_t SourceLength() const;
+
+        /// The buffer holding the source text, joined like Source after an edit
+        SourceBuffer::sptr const& Buffer() const;
+
+        /// Appends a token without a payload
+        void Append(TokenType type, std::uint32_t offset, std::uint32_t length);
+        /// Appends a `MNEMONIC` token
+        void AppendOpcode(std::uint32_t offset, std::uint32_t length, Opcode op);
+        /// Appends a literal token
+        void AppendValue(TokenType type, std::uint32_t offset, std::uint32_t length, std::int64_t value);
+        /// Appends a token whose text is `text`
+        void AppendText(TokenType type, std::uint32_t offset, std::uint32_t length, Span text);
+
+        /// Reserves room for roughly `count` tokens
+        void Reserve(std::size_t count);
+        /// Removes every token but keeps the storage for the next ones
+        void Clear();
+
+        /// How many literal values and text spans the payloads index into, some
+        /// of them may be unused after an edit
+        inline std::size_t ValueCount() const { return Values.size(); }
+        inline std::size_t TextCount() const { return Texts.size(); }
+
+        /// Sizes the stream for `count` tokens, `values` literal values and `texts` text spans
+        void Resize(std::size_t count, std::size_t values, std::size_t texts);
+
+        /// Copies every token of `part` into this stream, which must already be
+        /// large enough, starting at token `at`, value `value_at` and text
+        /// `text_at`. `part` must share this stream's source, neither may have
+        /// been edited.
+        ///
+        /// Parts that don't overlap may be copied from several threads at once.
+        void CopyPart(TokenStream const& part, std::size_t at, std::size_t value_at, std::size_t text_at);
+
+        /// Builds a Token object for a single token
+        TokenPtr ToToken(std::size_t idx) const;
+
+        /// Converts a single token into a debug string
+        std::string ToString(std::size_t idx) const;
+
+        /// The whole lines around an edit of the source
+        struct EditedLines {
+            /// Where the first of them starts
+            std::size_t Begin;
+            /// Where the last of them ended before the edit
+            std::size_t OldEnd;
+            /// The line the first of them is on
+            std::uint32_t Line;
+            /// What they read after the edit
+            std::string Text;
+        };
+
+        /// The lines that replacing `length` bytes of the source at `offset`
+        /// with `replacement` would touch, without changing anything
+        ///
+        /// Throws if the edit is outside the source or makes it too large.
+        EditedLines LinesOf(std::size_t offset, std::size_t length, std::string_view replacement) const;
+
+        /// Replaces `length` bytes of the source at `offset` with `replacement`
+        ///
+        /// Only the text and the newline index change, the tokens on the lines
+        /// around the edit (see LinesOf) must then be replaced with Splice. The
+        /// edited source isn't part of any SourceManager, so locations become
+        /// invalid. Throws like LinesOf, before changing anything.
+        void EditSource(std::size_t offset, std::size_t length, std::string_view replacement);
+
+        /// Replaces tokens `first` to `last` (exclusive) with the tokens of `part`
+        ///
+        /// `part` must have been lexed from the edited source starting at
+        /// `part_offset`, with offsets counted from there. The tokens after the
+        /// replaced ones move by `offset_delta` bytes.
+        void Splice(std::size_t first, std::size_t last, TokenStream const& part, std::size_t part_offset,
+            std::int64_t offset_delta);
+
+        /// How many bytes, tokens and line starts the edits so far have moved,
+        /// copied or scanned, not counting the copy of the source on the first one
+        inline std::uint64_t EditWork() const { return Work; }
+
+    private:
+        friend class TokenCache;
+
+        /// The source of a stream that was edited
+        struct EditedSource {
+            /// The text, with a gap at TextGap where the last edit ended
+            std::string Text;
+            std::size_t TextGap;
+            std::size_t TextGapSize;
+
+            /// Where each line starts, with a gap at LineGap. The starts
+            /// after the gap are stored LineShift bytes early.
+            std::vector<std::uint32_t> LineStarts;
+            std::size_t LineGap;
+            std::size_t LineGapSize;
+            std::uint32_t LineShift;
+
+            /// The text joined into one buffer, built on first use
+            struct Joined {
+                std::once_flag Once;
+                SourceBuffer::sptr Buffer;
+            };
+            std::shared_ptr<Joined> Whole;
+        };
+
+        std::string File;
+        SourceBuffer::sptr SourceText;
+        std::uint32_t FirstLine;
+        SourceLocation Origin;
+        std::optional<EditedSource> Edited;
+
+        std::vector<TokenType> Types;
+        std::vector<std::uint32_t> Offsets;
+        std::vector<std::uint32_t> Lengths;
+        std::vector<std::uint32_t> Payloads;
+
+        /// The token arrays have GapSize unused entries in front of token Gap.
+        /// The offsets of the tokens after the gap, and those of their text
+        /// spans, are stored Shift bytes early.
+        std::size_t Gap;
+        std::size_t GapSize;
+        std::uint32_t Shift;
+
+        std::vector<std::int64_t> Values;
+        std::vector<Span> Texts;
+        /// Values and texts of tokens that were spliced out, reused by the next ones
+        std::vector<std::uint32_t> FreeValues;
+        std::vector<std::uint32_t> FreeTexts;
+
+        std::uint64_t Work;
+
+        /// Where token `idx` is in the arrays
+        inline std::size_t At(std::size_t idx) const { return idx < Gap ? idx : idx + GapSize; }
+        /// What to add to the stored offsets of token `idx`
+        inline std::uint32_t ShiftOf(std::size_t idx) const { return idx < Gap ? 0 : Shift; }
+
+        /// `length` bytes of the source at `offset`, which must not cross the gap of an edited one
+        std::string_view SourceRange(std::size_t offset, std::size_t length) const;
+        /// The source in front of the gap of an edited one and after it, all of it and nothing otherwise
+        std::pair<std::string_view, std::string_view> SourceHalves() const;
+        /// The line `offset` is on
+        std::uint32_t LineAt(std::size_t offset) const;
+        /// Throws if an edit is outside the source or makes it too large
+        void CheckEdit(std::size_t offset, std::size_t length, std::string_view replacement) const;
+
+        /// Moves the gap in front of token `idx`
+        void MoveGap(std::size_t idx);
+        /// Makes the gap at least `count` tokens wide
+        void WidenGap(std::size_t count);
+    };
+
+    /// Converts a TokenStream into a debug string
+    std::string ToString(TokenStream const& tokens);
+
+}
@@ -3,7 +3,7 @@
 namespace npasm::lexer {
 
     /// Defines the type of token
-    enum class TokenType {
+    enum class TokenType : std::uint8_t {
         NEWLINE,
         COLON,
         SEMICOLON,
@@ -45,13 +45,16 @@ namespace npasm::lexer {
     };
 
     /// The base class of all token types
+    ///
+    /// The file is only known through Location, which is invalid for tokens that
+    /// weren't lexed from a file of a SourceManager.
     class Token {
     public:
         TokenType Type;
-        std::size_t LineNumber;
-        std::string_view FileName;
-        inline Token(std::string const& file_name, std::size_t line_number, TokenType type) :
-            Type{type}, LineNumber{line_number}, FileName{file_name} { }
+        std::uint32_t LineNumber;
+        SourceLocation Location;
+        inline Token(SourceLocation location, std::uint32_t line_number, TokenType type) :
+            Type{type}, LineNumber{line_number}, Location{location} { }
         virtual inline ~Token() { }
         virtual std::string ToString() const = 0;
     };
@@ -63,7 +66,7 @@ namespace npasm::lexer {
 #define TOKEN(name__) \
     class name__ : public Token { \
     public: \
-        inline name__(std::string const& file_name, std::size_t line_number) : Token{file_name, line_number, TokenType::name__} { } \
+        inline name__(SourceLocation location, std::uint32_t line_number) : Token{location, line_number, TokenType::name__} { } \
         virtual inline ~name__() { } \
         virtual inline std::string ToString() const override { \
             using namespace std; \
@@ -76,7 +79,7 @@ namespace npasm::lexer {
     class name__ : public Token { \
     public: \
         item_type__ item_name__; \
-        inline name__(std::string const& file_name, std::size_t line_number, item_type__ const& item_name__) : Token{file_name, line_number, TokenType::name__}, item_name__{item_name__} { } \
+        inline name__(SourceLocation location, std::uint32_t line_number, item_type__ const& item_name__) : Token{location, line_number, TokenType::name__}, item_name__{item_name__} { } \
         virtual inline ~name__() { } \
         virtual inline std::string ToString() const override { \
             using namespace std; \
@@ -90,7 +93,7 @@ namespace npasm::lexer {
     public: \
         item_type__ item_name__; \
         std::size_t length; \
-        inline name__(std::string const& file_name, std::size_t line_number, item_type__ const& item_name__, std::size_t length) : Token{file_name, line_number, TokenType::name__}, item_name__{item_name__}, length{length} { } \
+        inline name__(SourceLocation location, std::uint32_t line_number, item_type__ const& item_name__, std::size_t length) : Token{location, line_number, TokenType::name__}, item_name__{item_name__}, length{length} { } \
         virtual inline ~name__() { } \
         virtual inline std::string ToString() const override { \
             using namespace std; \
@@ -107,7 +110,7 @@ namespace npasm::lexer {
     
     TOKEN(NON_NEWLINE);
     
-    TOKEN1(MNEMONIC, std::string, mnemonic);
+    TOKEN1(MNEMONIC, Opcode, mnemonic);
     
     TOKEN1(WORD_SIZE, std::string, word_size);
     
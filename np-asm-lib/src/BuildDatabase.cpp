@@ -0,0 +1,264 @@
+#include "stdafx.h"
+#include "SourceBuffer.hpp"
+#include "BuildDatabase.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <time.h>
+#endif
+
+namespace npasm::build {
+
+    using namespace std;
+    using namespace npasm::lexer;
+
+    namespace {
+
+        constexpr string_view Magic = "np-asm-build";
+
+        /// Reads a field up to `separator` from `line` at `at` and moves `at` past the separator
+        string_view Field(string_view line, size_t& at, char separator = '\t') {
+            auto end = line.find(separator, at);
+            if(end == string_view::npos) {
+                end = line.length();
+            }
+            auto field = line.substr(at, end - at);
+            at = end + 1;
+            return field;
+        }
+
+        template<typename T>
+        bool ParseNumber(string_view text, T& value, int base = 10) {
+            auto result = from_chars(text.data(), text.data() + text.length(), value, base);
+            return result.ec == errc{} && result.ptr == text.data() + text.length();
+        }
+
+        /// Writes `path` so that it holds no tab or newline, which separate the fields and records
+        void PutEscaped(ostream& out, string_view path) {
+            for(auto c : path) {
+                switch(c) {
+                case '\\': out << "\\\\"; break;
+                case '\t': out << "\\t"; break;
+                case '\n': out << "\\n"; break;
+                case '\r': out << "\\r"; break;
+                default: out << c; break;
+                }
+            }
+        }
+
+        /// Undoes PutEscaped, std::nullopt if `field` isn't escaped like it does
+        optional<string> Unescape(string_view field) {
+            string ret;
+            ret.reserve(field.length());
+            for(size_t idx = 0; idx < field.length(); idx++) {
+                if(field[idx] != '\\') {
+                    ret += field[idx];
+                    continue;
+                }
+                if(++idx == field.length()) {
+                    return nullopt;
+                }
+                switch(field[idx]) {
+                case '\\': ret += '\\'; break;
+                case 't': ret += '\t'; break;
+                case 'n': ret += '\n'; break;
+                case 'r': ret += '\r'; break;
+                default: return nullopt;
+                }
+            }
+            return ret;
+        }
+
+        /// The time now, on the clock of FileStamp::ModifiedTime
+        std::int64_t FileClockNow() {
+#ifdef _WIN32
+            FILETIME now;
+            GetSystemTimeAsFileTime(&now);
+            return static_cast<std::int64_t>((static_cast<std::uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime);
+#else
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+        }
+
+    }
+
+#ifdef _WIN32
+    // FILETIMEs count 100 ns
+    const std::int64_t FileStamp::RacyWindow = 2 * 10000000LL;
+#else
+    const std::int64_t FileStamp::RacyWindow = 2 * 1000000000LL;
+#endif
+
+    std::optional<FileStamp> StampOf(std::string const& path) {
+        // Taken first, so the file can't have been written after the stamp says
+        auto now = FileClockNow();
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA info;
+        if(!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) {
+            return nullopt;
+        }
+        return FileStamp{
+            static_cast<std::int64_t>((static_cast<std::uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime),
+            (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow,
+            now,
+        };
+#else
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0) {
+            return nullopt;
+        }
+        return FileStamp{
+            static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec,
+            static_cast<std::uint64_t>(info.st_size),
+            now,
+        };
+#endif
+    }
+
+    BuildDatabase::BuildDatabase(std::string path) : File{std::move(path)}, Dirty{false} {
+        Load();
+    }
+
+    BuildDatabase::~BuildDatabase() { }
+
+    bool BuildDatabase::IsUpToDate(std::string const& input, std::string const& output, std::uint64_t options) {
+        auto stamp = StampOf(input);
+        if(!stamp || !StampOf(output)) {
+            return false;
+        }
+
+        std::uint64_t content_hash;
+        {
+            lock_guard<mutex> guard(Lock);
+            auto found = Records.find(input);
+            if(found == Records.end() || found->second.OptionsHash != options || found->second.Output != output) {
+                return false;
+            }
+            // A racy stamp can match after a change, so only the content can tell
+            if(found->second.Stamp == *stamp && !found->second.Stamp.IsRacy()) {
+                return true;
+            }
+            content_hash = found->second.ContentHash;
+        }
+
+        // Touched, the content decides
+        SourceBuffer::sptr text;
+        try {
+            text = SourceBuffer::FromFile(input);
+        } catch(std::exception const&) {
+            return false;
+        }
+        if(HashText(text->Text()) != content_hash) {
+            return false;
+        }
+        Record(input, output, options, *stamp, text->Text());
+        return true;
+    }
+
+    void BuildDatabase::Record(std::string const& input, std::string const& output, std::uint64_t options,
+        FileStamp stamp, std::string_view text) {
+        auto record = BuildRecord{ stamp, HashText(text), options, output };
+        lock_guard<mutex> guard(Lock);
+        Records.insert_or_assign(input, std::move(record));
+        Dirty = true;
+    }
+
+    void BuildDatabase::Forget(std::string const& input) {
+        lock_guard<mutex> guard(Lock);
+        Dirty |= Records.erase(input) != 0;
+    }
+
+    BuildRecord const* BuildDatabase::Find(std::string const& input) const {
+        lock_guard<mutex> guard(Lock);
+        auto found = Records.find(input);
+        return found != Records.end() ? &found->second : nullptr;
+    }
+
+    std::size_t BuildDatabase::size() const {
+        lock_guard<mutex> guard(Lock);
+        return Records.size();
+    }
+
+    void BuildDatabase::Save() {
+        lock_guard<mutex> guard(Lock);
+        if(!Dirty) {
+            return;
+        }
+
+        // Readers only ever see a complete database, or the old one
+        auto temp = File + "." + to_string(random_device{}()) + ".tmp";
+        {
+            ofstream out(temp, ios::binary);
+            out << Magic << " " << FormatVersion << "\n";
+            for(auto const& [input, record] : Records) {
+                out << hex << record.ContentHash << "\t" << record.OptionsHash << "\t" << dec
+                    << record.Stamp.ModifiedTime << "\t" << record.Stamp.Size << "\t" << record.Stamp.StampedAt << "\t";
+                PutEscaped(out, record.Output);
+                out << "\t";
+                PutEscaped(out, input);
+                out << "\n";
+            }
+            if(!out) {
+                out.close();
+                error_code error;
+                filesystem::remove(temp, error);
+                throw std::exception(("Unable to write " + temp).c_str());
+            }
+        }
+
+        error_code error;
+        filesystem::rename(temp, File, error);
+        if(error) {
+            filesystem::remove(temp, error);
+            throw std::exception(("Unable to write " + File).c_str());
+        }
+        Dirty = false;
+    }
+
+    void BuildDatabase::Load() {
+        error_code error;
+        if(!filesystem::is_regular_file(File, error)) {
+            return;
+        }
+
+        SourceBuffer::sptr buffer;
+        try {
+            buffer = SourceBuffer::FromFile(File);
+        } catch(std::exception const&) {
+            return;
+        }
+        auto text = buffer->Text();
+
+        size_t at = 0;
+        if(Field(text, at, '\n') != string(Magic) + " " + to_string(FormatVersion)) {
+            return;
+        }
+
+        // The paths are escaped, so a line that doesn't split into seven fields is damaged
+        while(at < text.length()) {
+            auto line = Field(text, at, '\n');
+            size_t field = 0;
+            BuildRecord record;
+            auto valid = ParseNumber(Field(line, field), record.ContentHash, 16) &&
+                ParseNumber(Field(line, field), record.OptionsHash, 16) &&
+                ParseNumber(Field(line, field), record.Stamp.ModifiedTime) &&
+                ParseNumber(Field(line, field), record.Stamp.Size) &&
+                ParseNumber(Field(line, field), record.Stamp.StampedAt);
+            auto output = valid && field < line.length() ? Unescape(Field(line, field)) : nullopt;
+            auto input = output && field <= line.length() ? Unescape(line.substr(field)) : nullopt;
+            if(!input || line.find('\t', field) != string_view::npos) {
+                Records.clear();
+                return;
+            }
+            record.Output = std::move(*output);
+            Records.insert_or_assign(std::move(*input), std::move(record));
+        }
+    }
+
+}
@@ -0,0 +1,330 @@
+#include "stdafx.h"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+#include "Tokens.hpp"
+#include "TokenStream.hpp"
+#include "Lexer.hpp"
+#include "Nodes.hpp"
+#include "Parser.hpp"
+#include "Encoder.hpp"
+
+namespace npasm::encoder {
+    using namespace std;
+    using namespace npasm::lexer;
+    using namespace npasm::parser;
+    using namespace npasm::encoder::layout;
+
+    void SymbolTable::Reserve(std::size_t count) {
+        Entries.reserve(count);
+        if(count * 2 > Slots.size()) {
+            Grow(count * 2);
+        }
+    }
+
+    void SymbolTable::Clear() {
+        Entries.clear();
+        fill(Slots.begin(), Slots.end(), Slot{});
+    }
+
+    bool SymbolTable::Insert(std::string_view name, std::uint32_t address) {
+        // Keep at least half of the slots free so probes stay short
+        if((Entries.size() + 1) * 2 > Slots.size()) {
+            Grow(max<size_t>(Slots.size() * 2, 16));
+        }
+
+        auto hash = static_cast<std::uint32_t>(std::hash<string_view>{}(name));
+        auto& slot = Slots[SlotOf(name, hash)];
+        if(slot.Entry != 0) {
+            return false;
+        }
+        Entries.push_back({ name, address });
+        slot = Slot{ hash, static_cast<std::uint32_t>(Entries.size()) };
+        return true;
+    }
+
+    std::uint32_t const* SymbolTable::Find(std::string_view name) const {
+        auto index = IndexOf(name);
+        return index != NotFound ? &Entries[index].Address : nullptr;
+    }
+
+    std::size_t SymbolTable::IndexOf(std::string_view name) const {
+        if(Slots.empty()) {
+            return NotFound;
+        }
+        auto const& slot = Slots[SlotOf(name, static_cast<std::uint32_t>(std::hash<string_view>{}(name)))];
+        return slot.Entry != 0 ? slot.Entry - 1 : NotFound;
+    }
+
+    std::uint32_t SymbolTable::At(std::string_view name) const {
+        auto address = Find(name);
+        if(address == nullptr) {
+            throw std::exception(("No symbol named " + string(name)).c_str());
+        }
+        return *address;
+    }
+
+    std::size_t SymbolTable::SlotOf(std::string_view name, std::uint32_t hash) const {
+        size_t mask = Slots.size() - 1;
+        for(size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+            auto const& slot = Slots[idx];
+            if(slot.Entry == 0 || (slot.Hash == hash && Entries[slot.Entry - 1].Name == name)) {
+                return idx;
+            }
+        }
+    }
+
+    void SymbolTable::Grow(std::size_t slots) {
+        size_t size = 16;
+        while(size < slots) {
+            size *= 2;
+        }
+
+        Slots.assign(size, Slot{});
+        for(size_t entry = 0; entry < Entries.size(); entry++) {
+            auto hash = static_cast<std::uint32_t>(std::hash<string_view>{}(Entries[entry].Name));
+            Slots[SlotOf(Entries[entry].Name, hash)] = Slot{ hash, static_cast<std::uint32_t>(entry + 1) };
+        }
+    }
+
+    Encoder::Encoder() : Target{nullptr}, Relocatable{false} { }
+
+    Encoder::~Encoder() { }
+
+    EncodeResult Encoder::Encode(Program const& program, std::string const& file_name, bool relocatable) {
+        Target = &program;
+        Relocatable = relocatable;
+        Binary.clear();
+        Fixups.clear();
+        Relocations.clear();
+        Errors.clear();
+
+        // Most instructions take a register and a short immediate
+        Binary.reserve(program.Instructions.size() * 6);
+        Labels.Clear();
+        Labels.Reserve(program.Labels.size());
+
+        for(auto const& line : program.Lines) {
+            if(line.Label) {
+                auto name = program[line.Label].Value;
+                if(!Labels.Insert(name, static_cast<std::uint32_t>(Binary.size()))) {
+                    Errors.push_back({ EncodeErrorCode::DuplicateLabel, OffsetOf(name), name, 0 });
+                }
+            }
+            if(line.Instruction) {
+                EncodeInstruction(program[line.Instruction], line.Offset);
+            }
+        }
+
+        for(auto& fixup : Fixups) {
+            fixup.Symbol = Labels.IndexOf(fixup.Label);
+            if(fixup.Symbol == SymbolTable::NotFound) {
+                // Leave room for any address, for the linker or so the partial binary keeps its layout if the label is added
+                fixup.Size = AddressSize;
+                if(!Relocatable) {
+                    Errors.push_back({ EncodeErrorCode::UndefinedLabel, OffsetOf(fixup.Label), fixup.Label, 0 });
+                }
+            } else if(Relocatable && !fixup.Relative) {
+                fixup.Size = AddressSize;
+            }
+        }
+        stable_sort(Errors.begin(), Errors.end(), [](auto const& a, auto const& b) { return a.Offset < b.Offset; });
+
+        Relax();
+        auto binary = Emit();
+        for(size_t label = 0; label < Addresses.size(); label++) {
+            Labels.SetAddress(label, Addresses[label]);
+        }
+
+        Target = nullptr;
+        return EncodeResult(std::move(binary), std::move(Labels), std::move(Relocations), std::move(Errors),
+            program.Source, file_name);
+    }
+
+    void Encoder::EncodeInstruction(Instruction const& inst, std::uint32_t line_offset) {
+        Binary.push_back(static_cast<std::uint8_t>(inst.Mnemonic));
+
+        auto word_size = WordSizeNone;
+        if(!inst.WordSize.empty()) {
+            word_size = (inst.WordSize[0] == 'b' || inst.WordSize[0] == 'B') ? WordSizeByte : WordSizeWord;
+        }
+        Binary.push_back(word_size);
+
+        auto branch = inst.Mnemonic == Opcode::JUMP || inst.Mnemonic == Opcode::CALL ||
+            inst.Mnemonic == Opcode::JUMPC || inst.Mnemonic == Opcode::CALLC;
+        auto first_fixup = Fixups.size();
+        for(size_t arg = 0; arg < inst.ArgumentCount; arg++) {
+            EncodeArgument(inst.Arguments[arg], line_offset, branch);
+        }
+        for(auto fixup = first_fixup; fixup < Fixups.size(); fixup++) {
+            Fixups[fixup].End = static_cast<std::uint32_t>(Binary.size());
+        }
+    }
+
+    void Encoder::EncodeArgument(NodeRef<Argument> arg, std::uint32_t line_offset, bool branch) {
+        std::uint8_t mode = 0;
+
+        // The parser only lets a pointer wrap an index, and an index wrap a register or immediate
+        if(auto ptr = Target->As<PointerArgument>(arg)) {
+            mode |= ModePointer;
+            arg = ptr->SubArgument;
+        }
+        if(auto x = Target->As<XIndexArgument>(arg)) {
+            mode |= ModeIndexX | (x->Plus ? 0 : ModeIndexMinus);
+            arg = x->SubArgument;
+        } else if(auto y = Target->As<YIndexArgument>(arg)) {
+            mode |= ModeIndexY | (y->Plus ? 0 : ModeIndexMinus);
+            arg = y->SubArgument;
+        }
+
+        visit(Overloaded{
+            [&](RegisterArgument const& reg) {
+                auto id = FindRegister(reg.Value);
+                if(!id) {
+                    Errors.push_back({ EncodeErrorCode::UnknownRegister, OffsetOf(reg.Value), reg.Value, 0 });
+                    id = RegisterId{};
+                }
+                Binary.push_back(mode);
+                Binary.push_back(static_cast<std::uint8_t>(id->Index * 8 + static_cast<std::uint8_t>(id->Part)));
+            },
+            [&](IntegerArgument const& integer) {
+                if(integer.Value < numeric_limits<std::int32_t>::min() ||
+                    integer.Value > numeric_limits<std::uint32_t>::max()) {
+                    Errors.push_back({ EncodeErrorCode::ImmediateOutOfRange, line_offset, {}, integer.Value });
+                }
+                // Values past INT32_MAX are bit patterns, which only four bytes sign-extend back to
+                auto size = integer.Value > numeric_limits<std::int32_t>::max() ? AddressSize : ImmediateSize(integer.Value);
+                EmitImmediate(Binary, mode, integer.Value, size);
+            },
+            [&](IdentifierArgument const& ident) {
+                // Only a plain target is relative, `JUMP [table]` reads the address from memory
+                auto relative = branch && mode == 0;
+                Binary.push_back(mode | ModeImmediate | (relative ? ModeRelative : 0));
+                Fixups.push_back({ static_cast<std::uint32_t>(Binary.size() - 1), 0, ident.Value,
+                    SymbolTable::NotFound, 0, 1, relative });
+            },
+            // Every alternative is named, so a new kind of argument doesn't compile until it is encoded
+            [&](PointerArgument const&) { throw std::exception("ENCODER: Pointers can't be nested"); },
+            [&](XIndexArgument const&) { throw std::exception("ENCODER: An index can't be indexed"); },
+            [&](YIndexArgument const&) { throw std::exception("ENCODER: An index can't be indexed"); },
+        }, (*Target)[arg]);
+    }
+
+    void Encoder::EmitImmediate(std::vector<std::uint8_t>& out, std::uint8_t mode, std::int64_t value, std::size_t size) {
+        out.push_back(mode | ModeImmediate | ModeSize(size));
+        auto bits = static_cast<std::uint32_t>(value);
+        for(size_t byte = 0; byte < size; byte++) {
+            out.push_back(static_cast<std::uint8_t>(bits >> (byte * 8)));
+        }
+    }
+
+    void Encoder::Relax() {
+        auto const& symbols = Labels.Symbols();
+        Addresses.resize(symbols.size());
+
+        // Both the labels and the fixups are in the order of the binary, so each pass is one sweep
+        for(bool grown = true; grown;) {
+            grown = false;
+
+            size_t next = 0;
+            std::uint32_t added = 0;
+            for(size_t label = 0; label < symbols.size(); label++) {
+                for(; next < Fixups.size() && Fixups[next].At < symbols[label].Address; next++) {
+                    added += Fixups[next].Size;
+                }
+                Addresses[label] = symbols[label].Address + added;
+            }
+
+            next = 0;
+            added = 0;
+            for(auto& fixup : Fixups) {
+                for(; next < Fixups.size() && Fixups[next].At < fixup.End; next++) {
+                    added += Fixups[next].Size;
+                }
+                if(fixup.Symbol == SymbolTable::NotFound) {
+                    // As if the label were at 0, the relocation's addend makes up for the rest
+                    fixup.Value = Relocatable && fixup.Relative ? -(static_cast<std::int64_t>(fixup.End) + added) : 0;
+                    continue;
+                }
+
+                fixup.Value = Addresses[fixup.Symbol];
+                if(fixup.Relative) {
+                    fixup.Value -= static_cast<std::int64_t>(fixup.End) + added;
+                }
+                auto size = static_cast<std::uint8_t>(ImmediateSize(fixup.Value));
+                if(size > fixup.Size) {
+                    fixup.Size = size;
+                    grown = true;
+                }
+            }
+        }
+    }
+
+    std::vector<std::uint8_t> Encoder::Emit() {
+        size_t added = 0;
+        for(auto const& fixup : Fixups) {
+            added += fixup.Size;
+        }
+
+        vector<std::uint8_t> out;
+        out.reserve(Binary.size() + added);
+        size_t from = 0;
+        for(auto const& fixup : Fixups) {
+            out.insert(out.end(), Binary.begin() + from, Binary.begin() + fixup.At);
+            EmitImmediate(out, Binary[fixup.At], fixup.Value, fixup.Size);
+            from = fixup.At + 1;
+
+            if(Relocatable && (fixup.Symbol == SymbolTable::NotFound || !fixup.Relative)) {
+                auto field = static_cast<std::uint32_t>(out.size() - fixup.Size);
+                auto addend = fixup.Relative ? field + fixup.Value : 0;
+                Relocations.push_back({ field, fixup.Label, static_cast<std::int32_t>(addend), fixup.Relative });
+            }
+        }
+        out.insert(out.end(), Binary.begin() + from, Binary.end());
+        return out;
+    }
+
+    std::uint32_t Encoder::OffsetOf(std::string_view text) const {
+        return static_cast<std::uint32_t>(text.data() - Target->Source->Text().data());
+    }
+
+    EncodeResult::EncodeResult(std::vector<std::uint8_t> binary, SymbolTable labels, std::vector<Relocation> relocations,
+        std::vector<EncodeError> errors, SourceBuffer::sptr source, std::string file_name) :
+        Binary{std::move(binary)}, Addresses{std::move(labels)}, Fields{std::move(relocations)}, Diagnostics{std::move(errors)},
+        Source{source}, File{std::move(file_name)} { }
+
+    std::vector<std::uint8_t> const& EncodeResult::Value() const {
+        if(!HasValue()) {
+            throw std::exception(("ENCODER: " + FormatErrors()).c_str());
+        }
+        return Binary;
+    }
+
+    std::string EncodeResult::FormatErrors() const {
+        string ret = "";
+
+        for(auto const& error : Diagnostics) {
+            auto line = Source->LineOf(error.Offset);
+            ret += File + ":" + to_string(line + 1) + ":" + to_string(error.Offset - Source->LineStart(line) + 1) + ": error: ";
+
+            switch(error.Code) {
+            case EncodeErrorCode::UndefinedLabel:
+                ret += "undefined label '" + string(error.Name) + "'";
+                break;
+            case EncodeErrorCode::DuplicateLabel:
+                ret += "label '" + string(error.Name) + "' is already defined";
+                break;
+            case EncodeErrorCode::ImmediateOutOfRange:
+                ret += to_string(error.Value) + " doesn't fit in 32 bits";
+                break;
+            case EncodeErrorCode::UnknownRegister:
+                ret += "unknown register '$" + string(error.Name) + "'";
+                break;
+            }
+            ret += "\n";
+        }
+
+        return ret;
+    }
+
+}
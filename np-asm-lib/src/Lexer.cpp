@@ -1,798 +1,843 @@
 #include "stdafx.h"
+#include "Simd.hpp"
+#include "Parallel.hpp"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
 #include "Tokens.hpp"
+#include "TokenStream.hpp"
 #include "Lexer.hpp"
 
 namespace npasm::lexer {
 
     using namespace std;
-    namespace rc = std::regex_constants;
 
-    Lexer::Lexer() : FileName{""}, CurrentLine{0} { }
+    Lexer::Lexer() : FileName{""}, FirstLine{0} { }
 
     Lexer::~Lexer() { }
 
-    std::vector<TokenPtr> Lexer::LexFile(std::string const & str) {
-        std::ifstream inf(str);
-        if(inf) {
-            std::ostringstream contents;
-            contents << inf.rdbuf();
-            inf.close();
-            FileName = str;
-            CurrentLine = 0;
-            return LexStringIntern(contents.str());
-        }
-        throw std::exception("Unable to open source file");
+    TokenStream Lexer::LexFile(std::string const & str) {
+        auto source = SourceBuffer::FromFile(str);
+        FileName = str;
+        FirstLine = 0;
+        auto tokens = TokenStream(FileName, source);
+        LexStringIntern(tokens.Source(), tokens);
+        return tokens;
+    }
+
+    TokenStream Lexer::LexFile(std::string const& str, std::size_t threads) {
+        auto source = SourceBuffer::FromFile(str);
+        FileName = str;
+        FirstLine = 0;
+        auto tokens = TokenStream(FileName, source);
+        LexParallel(tokens, threads);
+        return tokens;
     }
 
-    std::vector<TokenPtr> Lexer::LexString(std::string const & str) {
+    TokenStream Lexer::LexString(std::string_view str) {
         FileName = "__LEXED_STRING__";
-        CurrentLine = 0;
-        return LexStringIntern(str);
+        FirstLine = 0;
+        auto tokens = TokenStream(FileName, SourceBuffer::FromString(str));
+        LexStringIntern(tokens.Source(), tokens);
+        return tokens;
     }
 
-    vector<TokenPtr> Lexer::LexStringIntern(string const & str) {
-        vector<TokenPtr> tokens = {};
-        size_t start_idx = 0;
+    TokenStream Lexer::Lex(SourceManager const& sources, FileId file, std::size_t threads) {
+        FileName = sources.FileName(file);
+        FirstLine = 0;
+        auto tokens = TokenStream(FileName, sources.Buffer(file), 0, sources.Location(file, 0));
+        LexParallel(tokens, threads);
+        return tokens;
+    }
 
-        while(start_idx < str.length()) {
+    TokenStream Lexer::BeginLines(std::string const& file_name, SourceBuffer::sptr source) {
+        FileName = file_name;
+        FirstLine = 0;
+        return TokenStream(FileName, source);
+    }
 
-            if((str[start_idx] == ' ') || // Ignore non-newline whitespace
-                (str[start_idx] == '\t') ||
-                (str[start_idx] == '\v') ||
-                (str[start_idx] == '\a') ||
-                (str[start_idx] == '\b') ||
-                (str[start_idx] == '\f') ||
-                (str[start_idx] == '\r')) {
-                start_idx++;
-                continue;
-            }
+    TokenStream Lexer::BeginLines(SourceManager const& sources, FileId file) {
+        FileName = sources.FileName(file);
+        FirstLine = 0;
+        return TokenStream(FileName, sources.Buffer(file), 0, sources.Location(file, 0));
+    }
 
-            auto tok = IsNEWLINE(str.substr(start_idx));
+    std::size_t Lexer::LexLines(TokenStream& tokens, std::size_t offset, std::size_t bytes) {
+        auto str = tokens.Source();
+        size_t from = min(offset + max<size_t>(bytes, 1) - 1, str.length());
+        size_t end = min(simd::FindNewline(str, from) + 1, str.length());
+        tokens.Clear();
+        // Ending the view at the newline is safe, the scanner never looks past one
+        LexStringIntern(str.substr(0, end), tokens, offset);
+        return end;
+    }
 
-            if(tok != nullptr) { // Success
-                tokens.push_back(tok);
-                start_idx++;
-                CurrentLine++;
-                continue;
-            }
+    void Lexer::Relex(TokenStream& tokens, std::size_t offset, std::size_t length, std::string_view replacement) {
+        // The edit is widened to whole lines, no token crosses a newline
+        auto lines = tokens.LinesOf(offset, length, replacement);
 
-            if(tok = IsCOLON(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx++;
-                continue;
+        auto first_at = [&](size_t pos) {
+            size_t lo = 0, hi = tokens.size();
+            while(lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if(tokens.Offset(mid) < pos) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
             }
+            return lo;
+        };
+        size_t first = first_at(lines.Begin);
+        size_t last = first_at(lines.OldEnd);
+
+        // Lex the new lines before changing anything, so an edit that doesn't
+        // lex (a literal half typed out of range) leaves the stream as it was
+        auto part = TokenStream();
+        FileName = tokens.FileName();
+        FirstLine = lines.Line;
+        LexStringIntern(lines.Text, part);
+
+        tokens.EditSource(offset, length, replacement);
+        tokens.Splice(first, last, part, lines.Begin,
+            static_cast<std::int64_t>(replacement.length()) - static_cast<std::int64_t>(length));
+    }
+
+    namespace {
+
+        /// Character classes used by the scanner, indexed by byte value
+        enum CharClass : std::uint8_t {
+            CC_BLANK = 0x01,
+            CC_IDENT_START = 0x02,
+            CC_IDENT = 0x04,
+            CC_BIN = 0x08,
+            CC_OCT = 0x10,
+            CC_DEC = 0x20,
+            CC_HEX = 0x40,
+            /// Can begin a token, every other byte is skipped
+            CC_START = 0x80,
+        };
 
-            if(tok = IsCOMMENT(str.substr(start_idx)); tok != nullptr) {
-                auto comment = static_pointer_cast<COMMENT>(tok);
-                tokens.push_back(tok);
-                start_idx += comment->comment.length() + 1;
-                continue;
+        constexpr std::array<std::uint8_t, 256> MakeCharClasses() {
+            std::array<std::uint8_t, 256> table{};
+            for(char c : { ' ', '\t', '\v', '\a', '\b', '\f', '\r' }) {
+                table[(unsigned char)c] |= CC_BLANK;
             }
-
-            if(tok = IsSEMICOLON(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx++;
-                continue;
+            for(int c = 'a'; c <= 'z'; c++) {
+                table[c] |= CC_IDENT_START | CC_IDENT;
+                table[c - 'a' + 'A'] |= CC_IDENT_START | CC_IDENT;
             }
-
-            /*if(tok = IsNON_NEWLINE(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx++;
-                continue;
-            }*/
-
-            if(tok = IsMNEMONIC(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += static_pointer_cast<MNEMONIC>(tok)->mnemonic.length();
-                continue;
+            table['_'] |= CC_IDENT_START | CC_IDENT;
+            for(int c = '0'; c <= '9'; c++) {
+                table[c] |= CC_IDENT | CC_DEC | CC_HEX;
+                if(c <= '7') table[c] |= CC_OCT;
+                if(c <= '1') table[c] |= CC_BIN;
             }
-
-            if(tok = IsWORD_SIZE(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += static_pointer_cast<WORD_SIZE>(tok)->word_size.length();
-                continue;
+            for(int c = 'a'; c <= 'f'; c++) {
+                table[c] |= CC_HEX;
+                table[c - 'a' + 'A'] |= CC_HEX;
             }
-
-            if(tok = IsCOMMA(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx++;
-                continue;
+            for(char c : { '\n', ':', ',', '[', ']', ';', '$', '\'', '+', '-' }) {
+                table[(unsigned char)c] |= CC_START;
             }
-
-            if(tok = IsREGISTER(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += static_pointer_cast<REGISTER>(tok)->reg.length();
-                continue;
+            for(auto& cls : table) {
+                if(cls & (CC_IDENT_START | CC_DEC)) {
+                    cls |= CC_START;
+                }
             }
+            return table;
+        }
 
-            if(tok = IsLEFT_BRACKET(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx++;
-                continue;
-            }
+        constexpr auto CharClasses = MakeCharClasses();
 
-            if(tok = IsRIGHT_BRACKET(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx++;
-                continue;
-            }
+        inline bool Is(char c, std::uint8_t cls) {
+            return (CharClasses[(unsigned char)c] & cls) != 0;
+        }
 
-            if(tok = IsXPLUS(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += 2;
-                continue;
-            }
+        /// Returns the character at `idx` or `'\0'` when past the end of `str`
+        inline char At(string_view str, size_t idx) {
+            return idx < str.length() ? str[idx] : '\0';
+        }
 
-            if(tok = IsXMINUS(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += 2;
-                continue;
-            }
+        inline char ToUpper(char c) {
+            return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+        }
 
-            if(tok = IsYPLUS(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += 2;
-                continue;
+        /// Case-insensitively compares `str` at `idx` against the upper-case `word`
+        inline bool MatchesNoCase(string_view str, size_t idx, string_view word) {
+            if(str.length() - idx < word.length()) {
+                return false;
             }
-
-            if(tok = IsYMINUS(str.substr(start_idx)); tok != nullptr) {
-                tokens.push_back(tok);
-                start_idx += 2;
-                continue;
+            for(size_t i = 0; i < word.length(); i++) {
+                if(ToUpper(str[idx + i]) != word[i]) {
+                    return false;
+                }
             }
+            return true;
+        }
 
-            if(tok = IsLABEL(str.substr(start_idx)); tok != nullptr) {
-                auto l = static_pointer_cast<LABEL>(tok);
-                tokens.push_back(tok);
-                start_idx += l->length;
-                continue;
-            }
+        constexpr string_view WordSizes[] = { "WORD", "BYTE" };
 
-            if(tok = IsIDENTIFIER(str.substr(start_idx)); tok != nullptr) {
-                auto ident = static_pointer_cast<IDENTIFIER>(tok);
-                tokens.push_back(tok);
-                start_idx += ident->ident.length();
-                continue;
+        template<size_t N>
+        bool IsWordIn(string_view str, size_t idx, size_t length, string_view const (&words)[N]) {
+            for(auto const& word : words) {
+                if(word.length() == length && MatchesNoCase(str, idx, word)) {
+                    return true;
+                }
             }
+            return false;
+        }
 
-            if(tok = IsDECIMAL_LITERAL(str.substr(start_idx)); tok != nullptr) {
-                auto lit = static_pointer_cast<DECIMAL_LITERAL>(tok);
-                tokens.push_back(tok);
-                start_idx += lit->length;
-                continue;
-            }
+        inline bool IsSimpleChar(char c) {
+            auto u = (unsigned char)c;
+            return (u >= 0x20) && (u <= 0xfe) && (c != '\'') && (c != '\\');
+        }
 
-            if(tok = IsBINARY_LITERAL(str.substr(start_idx)); tok != nullptr) {
-                auto lit = static_pointer_cast<BINARY_LITERAL>(tok);
-                tokens.push_back(tok);
-                start_idx += lit->length;
-                continue;
+        inline bool IsControlEscape(char c) {
+            switch(c) {
+            case 'a': case 'b': case 'f': case 'n': case 'r':
+            case 't': case 'v': case '\'': case '0': case '\\':
+                return true;
+            default:
+                return false;
             }
+        }
 
-            if(tok = IsHEX_LITERAL(str.substr(start_idx)); tok != nullptr) {
-                auto lit = static_pointer_cast<HEX_LITERAL>(tok);
-                tokens.push_back(tok);
-                start_idx += lit->length;
-                continue;
+        /// The value of a digit in any base up to 16, or 16 for anything else
+        inline unsigned DigitValue(char c) {
+            if(c >= '0' && c <= '9') {
+                return c - '0';
             }
-
-            if(tok = IsOCTAL_LITERAL(str.substr(start_idx)); tok != nullptr) {
-                auto lit = static_pointer_cast<OCTAL_LITERAL>(tok);
-                tokens.push_back(tok);
-                start_idx += lit->length;
-                continue;
+            c = ToUpper(c);
+            if(c >= 'A' && c <= 'F') {
+                return c - 'A' + 10;
             }
+            return 16;
+        }
 
-            if(tok = IsCHAR_LITERAL(str.substr(start_idx)); tok != nullptr) {
-                auto lit = static_pointer_cast<CHAR_LITERAL>(tok);
-                tokens.push_back(tok);
-                start_idx += lit->length;
-                continue;
+        /// Reads `digits` in `base` as an unsigned 64 bit pattern, without allocating
+        ///
+        /// \returns `errc::invalid_argument` if `digits` is empty or holds something
+        /// else than digits of `base`, `errc::result_out_of_range` if the value
+        /// needs more than 64 bits
+        std::errc ParseUnsigned(string_view digits, int base, std::uint64_t& value) {
+            auto first = digits.data();
+            auto last = first + digits.length();
+            auto [end, err] = from_chars(first, last, value, base);
+            if(err == std::errc{} && end != last) {
+                return std::errc::invalid_argument;
             }
-
-            start_idx++;
+            return err;
         }
 
-        return tokens;
     }
 
-    TokenPtr Lexer::IsNEWLINE(string const& str) {
-        static regex re = regex(R"(\n)");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<NEWLINE>(FileName, CurrentLine);
-        } else {
-            return nullptr;
+    void Lexer::LexStringIntern(string_view str, TokenStream& tokens, size_t start_idx) {
+        if(str.length() > numeric_limits<std::uint32_t>::max()) {
+            throw std::exception("Source file is too large");
         }
-    }
 
-    TokenPtr Lexer::IsCOLON(string const& str) {
-        static regex re = regex(":");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<COLON>(FileName, CurrentLine);
-        } else {
-            return nullptr;
-        }
-    }
+        tokens.Reserve((str.length() - start_idx) / 4);
 
-    TokenPtr Lexer::IsSEMICOLON(string const& str) {
-        static regex re = regex(";");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<SEMICOLON>(FileName, CurrentLine);
-        } else {
-            return nullptr;
-        }
-    }
+        while(start_idx < str.length()) {
 
-    TokenPtr Lexer::IsNON_NEWLINE(string const& str) {
-        static regex re = regex(R"([^\n])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<NON_NEWLINE>(FileName, CurrentLine);
-        } else {
-            return nullptr;
-        }
-    }
+            if(Is(str[start_idx], CC_BLANK)) { // Ignore non-newline whitespace
+                start_idx = simd::SkipBlanks(str, start_idx + 1);
+                continue;
+            }
 
-    TokenPtr Lexer::IsMNEMONIC(string const & str) {
-        static regex re = regex(boost::erase_all_copy(
-            R"(NOP|
-MOVE|
-SWAP|
-ADD|
-SUB|
-INC|
-DEC|
-MULS|
-MUL|
-DIVS|
-DIV|
-MODS|
-MOD|
-AND|
-BOR|
-XOR|
-SHRA|
-SHR|
-SHL|
-CMPZ|
-CMPNZ|
-CMPEQ|
-CMPNE|
-CMPGTS|
-CMPLTS|
-CMPGES|
-CMPLES|
-CMPGT|
-CMPLT|
-CMPGE|
-CMPLE|
-STACK|
-PUSH|
-POP|
-JUMPC|
-CALLC|
-JUMP|
-CALL|
-RET|
-INT|
-IRET|
-IQE|
-IQD|
-ISET|
-IRSET|
-ION|
-IOFF|
-HWIN|
-HWOUT|
-HWNUM|
-HWQRY|
-HWINT|
-HALT)"s,
-"\n"s
-), rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<MNEMONIC>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
-        }
-    }
+            auto lex = ScanLexeme(str, start_idx);
 
-    TokenPtr Lexer::IsWORD_SIZE(string const & str) {
-        static regex re = regex(R"(word|byte)", rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<WORD_SIZE>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
-        }
-    }
+            if(lex.Length == 0) { // Unrecognized character, skip it and everything up to the next possible token
+                start_idx++;
+                while(start_idx < str.length() && !Is(str[start_idx], CC_START | CC_BLANK)) {
+                    start_idx++;
+                }
+                continue;
+            }
 
-    TokenPtr Lexer::IsCOMMA(string const& str) {
-        static regex re = regex(",");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<COMMA>(FileName, CurrentLine);
-        } else {
-            return nullptr;
+            Emit(tokens, start_idx, lex);
+            start_idx += lex.Length;
         }
     }
 
-    TokenPtr Lexer::IsREGISTER(string const & str) {
-        static regex re = regex(boost::erase_all_copy(
-            R"(\$((ACC|COMP|EXC|INTQ|INT|ION|STL|SP|PC|A|B|C|D|E|F|G|H|X|Y)((l(l|h)?)|(h(l|h)?))?))"s,
-            "\n"s), rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<REGISTER>(FileName, CurrentLine, m.str(1));
-        } else {
-            return nullptr;
+    void Lexer::LexParallel(TokenStream& tokens, size_t threads) {
+        auto str = tokens.Source();
+        if(str.length() > numeric_limits<std::uint32_t>::max()) {
+            throw std::exception("Source file is too large");
         }
-    }
 
-    TokenPtr Lexer::IsBINARY_DIGIT(string const& str) {
-        static regex re = regex(R"([01])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<BINARY_DIGIT>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+        if(threads == 0) {
+            threads = max<size_t>(thread::hardware_concurrency(), 1);
         }
-    }
-
-    TokenPtr Lexer::IsOCTAL_DIGIT(string const& str) {
-        static regex re = regex(R"([0-7])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<OCTAL_DIGIT>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+        threads = min(threads, max<size_t>(str.length() / MinParallelChunk, 1));
+        if(threads <= 1) {
+            LexStringIntern(str, tokens);
+            return;
         }
-    }
 
-    TokenPtr Lexer::IsDECIMAL_DIGIT(string const& str) {
-        static regex re = regex(R"([0-9])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<DECIMAL_DIGIT>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+        // Cut just after the first newline past each even split
+        vector<size_t> bounds = { 0 };
+        for(size_t i = 1; i < threads; i++) {
+            size_t cut = simd::FindNewline(str, max(str.length() / threads * i, bounds.back())) + 1;
+            if(cut >= str.length()) {
+                break;
+            }
+            bounds.push_back(cut);
+        }
+        bounds.push_back(str.length());
+        size_t count = bounds.size() - 1;
+
+        vector<TokenStream> parts(count, TokenStream(FileName, tokens.Buffer()));
+
+        ParallelFor(count, count, [&](size_t part) {
+            auto lexer = Lexer();
+            lexer.FileName = FileName;
+            lexer.FirstLine = FirstLine;
+            // Ending the view at the cut is safe, the scanner never looks past a newline
+            lexer.LexStringIntern(str.substr(0, bounds[part + 1]), parts[part], bounds[part]);
+        });
+
+        // Work out where each part lands in the joined stream
+        vector<size_t> at(count + 1, 0), value_at(count + 1, 0), text_at(count + 1, 0);
+        for(size_t part = 0; part < count; part++) {
+            at[part + 1] = at[part] + parts[part].size();
+            value_at[part + 1] = value_at[part] + parts[part].ValueCount();
+            text_at[part + 1] = text_at[part] + parts[part].TextCount();
         }
+
+        tokens.Resize(at[count], value_at[count], text_at[count]);
+        ParallelFor(count, count, [&](size_t part) {
+            tokens.CopyPart(parts[part], at[part], value_at[part], text_at[part]);
+        });
     }
 
-    TokenPtr Lexer::IsHEX_DIGIT(string const& str) {
-        static regex re = regex(R"([0-9a-fA-F])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<HEX_DIGIT>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
-        }
-    }
+    void Lexer::Emit(TokenStream& tokens, size_t idx, Lexeme const& lex) {
+        auto offset = static_cast<std::uint32_t>(idx);
+        auto length = static_cast<std::uint32_t>(lex.Length);
 
-    TokenPtr Lexer::IsLEFT_BRACKET(string const& str) {
-        static regex re = regex(R"(\[)");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<LEFT_BRACKET>(FileName, CurrentLine);
-        } else {
-            return nullptr;
+        switch(lex.Type) {
+        case TokenType::MNEMONIC:
+            tokens.AppendOpcode(offset, length, static_cast<Opcode>(lex.Value));
+            break;
+        case TokenType::WORD_SIZE:
+        case TokenType::REGISTER:
+        case TokenType::IDENTIFIER:
+        case TokenType::LABEL:
+        case TokenType::COMMENT:
+            tokens.AppendText(lex.Type, offset, length, {
+                static_cast<std::uint32_t>(idx + lex.TextOffset), static_cast<std::uint32_t>(lex.TextLength)
+            });
+            break;
+        case TokenType::BINARY_LITERAL:
+        case TokenType::OCTAL_LITERAL:
+        case TokenType::DECIMAL_LITERAL:
+        case TokenType::HEX_LITERAL:
+        case TokenType::CHAR_LITERAL:
+            tokens.AppendValue(lex.Type, offset, length, lex.Value);
+            break;
+        default:
+            tokens.Append(lex.Type, offset, length);
+            break;
         }
     }
 
-    TokenPtr Lexer::IsRIGHT_BRACKET(string const& str) {
-        static regex re = regex(R"(\])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<RIGHT_BRACKET>(FileName, CurrentLine);
-        } else {
-            return nullptr;
-        }
-    }
+    Lexer::Lexeme Lexer::ScanLexeme(string_view str, size_t idx) {
+        char c = str[idx];
 
-    TokenPtr Lexer::IsXPLUS(string const & str) {
-        static regex re = regex(R"(X\+)", rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<XPLUS>(FileName, CurrentLine);
-        } else {
-            return nullptr;
+        switch(c) {
+        case '\n':
+            return { TokenType::NEWLINE, 1 };
+        case ':':
+            return { TokenType::COLON, 1 };
+        case ',':
+            return { TokenType::COMMA, 1 };
+        case '[':
+            return { TokenType::LEFT_BRACKET, 1 };
+        case ']':
+            return { TokenType::RIGHT_BRACKET, 1 };
+        case ';':
+            return ScanComment(str, idx);
+        case '$':
+            return ScanRegister(str, idx);
+        case '\'':
+            return ScanCharLiteral(str, idx);
+        case '+':
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return ScanNumber(str, idx);
+        default:
+            if(Is(c, CC_IDENT_START)) {
+                return ScanWord(str, idx);
+            }
+            return {};
         }
     }
 
-    TokenPtr Lexer::IsXMINUS(string const & str) {
-        static regex re = regex(R"(X-)", rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<XMINUS>(FileName, CurrentLine);
-        } else {
-            return nullptr;
-        }
-    }
+    Lexer::Lexeme Lexer::ScanWord(string_view str, size_t idx) {
+        auto ident = ScanIdentifier(str, idx);
+        char next = At(str, idx + ident.Length);
 
-    TokenPtr Lexer::IsYPLUS(string const & str) {
-        static regex re = regex(R"(Y\+)", rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<YPLUS>(FileName, CurrentLine);
-        } else {
-            return nullptr;
+        if(ident.Length == 1 && (next == '+' || next == '-')) {
+            switch(ToUpper(str[idx])) {
+            case 'X':
+                return { next == '+' ? TokenType::XPLUS : TokenType::XMINUS, 2 };
+            case 'Y':
+                return { next == '+' ? TokenType::YPLUS : TokenType::YMINUS, 2 };
+            }
         }
-    }
 
-    TokenPtr Lexer::IsYMINUS(string const & str) {
-        static regex re = regex(R"(Y-)", rc::icase);
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<YMINUS>(FileName, CurrentLine);
-        } else {
-            return nullptr;
+        if(auto op = FindOpcode(str.substr(idx, ident.Length)); op.has_value()) {
+            return { TokenType::MNEMONIC, ident.Length, 0, ident.Length, static_cast<std::int64_t>(*op) };
         }
-    }
 
-    TokenPtr Lexer::IsSIMPLE_CHAR(string const& str) {
-        static regex re = regex(R"([\x20-\x26\x28-\x5b\x5d-\xfe])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<SIMPLE_CHAR>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+        if(IsWordIn(str, idx, ident.Length, WordSizes)) {
+            return { TokenType::WORD_SIZE, ident.Length, 0, ident.Length };
         }
-    }
 
-    TokenPtr Lexer::IsESCAPED_CONTROL_CHAR(string const & str) {
-        static regex re = regex(R"(\\[abfnrtv'0\\])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<ESCAPED_CONTROL_CHAR>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+        if(auto label = ScanLabel(str, idx, ident); label.Length != 0) {
+            return label;
         }
-    }
 
-    TokenPtr Lexer::IsESCAPED_OCTAL_CHAR(string const & str) {
-        static regex re = regex(R"(\\[0-7][0-7][0-7])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<ESCAPED_OCTAL_CHAR>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
-        }
+        return ident;
     }
 
-    TokenPtr Lexer::IsESCAPED_HEX_CHAR(string const & str) {
-        static regex re = regex(R"(\\x[0-9a-fA-F][0-9a-fA-F])");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<ESCAPED_HEX_CHAR>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+    Lexer::Lexeme Lexer::ScanIdentifier(string_view str, size_t idx) {
+        if(!Is(At(str, idx), CC_IDENT_START)) {
+            return {};
         }
-    }
-
-    TokenPtr Lexer::IsIDENTIFIER(std::string const & str) {
-        static regex re = regex(R"([a-zA-Z_][0-9a-zA-Z_]*)");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<IDENTIFIER>(FileName, CurrentLine, m.str());
-        } else {
-            return nullptr;
+        size_t end = idx + 1;
+        while(Is(At(str, end), CC_IDENT)) {
+            end++;
         }
+        return { TokenType::IDENTIFIER, end - idx, 0, end - idx };
     }
 
-    TokenPtr Lexer::IsLABEL(std::string const & str) {
-        // This is slightly more complicated we scan for two tokens in sequence
-        auto ident = IsIDENTIFIER(str);
-        if(ident == nullptr) {
-            return nullptr;
+    Lexer::Lexeme Lexer::ScanLabel(string_view str, size_t idx, Lexeme const& ident) {
+        size_t end = idx + ident.Length;
+        while(Is(At(str, end), CC_BLANK)) {
+            end++;
         }
-        size_t idx = static_pointer_cast<IDENTIFIER>(ident)->ident.length();
-        idx += SkipWhitespace(str.substr(idx));
-        auto colon = IsCOLON(str.substr(idx));
-        if(colon == nullptr) {
-            return nullptr;
+        if(At(str, end) != ':') {
+            return {};
         }
-        return make_shared<LABEL>(FileName, CurrentLine, static_pointer_cast<IDENTIFIER>(ident)->ident, idx + 1);
+        return { TokenType::LABEL, end + 1 - idx, 0, ident.Length };
     }
 
-    TokenPtr Lexer::IsCOMMENT(std::string const& str) {
-        static regex re = regex(R"(;([^\n]*))");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            return make_shared<COMMENT>(FileName, CurrentLine, m.str(1));
-        } else {
-            return nullptr;
-        }
+    Lexer::Lexeme Lexer::ScanComment(string_view str, size_t idx) {
+        auto end = simd::FindNewline(str, idx + 1);
+        return { TokenType::COMMENT, end - idx, 1, end - idx - 1 };
     }
 
-    TokenPtr Lexer::IsBINARY_LITERAL(std::string const & str) {
-        static regex re = regex(R"(([\+-]?)0b([01]+))");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-
-            auto value = FromBinary(m.str(2));
-            if(m.str(1) == "-") {
-                value *= -1;
+    Lexer::Lexeme Lexer::ScanRegister(string_view str, size_t idx) {
+        for(auto const& name : RegisterNames) {
+            if(!MatchesNoCase(str, idx + 1, name)) {
+                continue;
             }
-
-            return make_shared<BINARY_LITERAL>(FileName, CurrentLine, value, m.str(0).length());
-        } else {
-            return nullptr;
-        }
-    }
-
-    TokenPtr Lexer::IsOCTAL_LITERAL(std::string const & str) {
-        static regex re = regex(R"(([\+-]?)(0[0-7]*))");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-
-            std::int64_t value;
-
-            if(m.str(2) == "0") {
-                value = 0;
-            } else {
-                value = FromOctal(m.str(2));
-                if(m.str(1) == "-") {
-                    value *= -1;
+            size_t end = idx + 1 + name.length();
+            if(char c = ToUpper(At(str, end)); c == 'L' || c == 'H') {
+                end++;
+                if(char c2 = ToUpper(At(str, end)); c2 == 'L' || c2 == 'H') {
+                    end++;
                 }
             }
-
-            return make_shared<OCTAL_LITERAL>(FileName, CurrentLine, value, m.str(0).length());
-        } else {
-            return nullptr;
+            return { TokenType::REGISTER, end - idx, 1, end - idx - 1 };
         }
+        return {};
     }
 
-    TokenPtr Lexer::IsDECIMAL_LITERAL(std::string const & str) {
-        static regex re = regex(R"(([\+-]?)([1-9][0-9]*))");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
-            using namespace boost;
-            using namespace boost::cnv;
-            static boost::cnv::cstream cnv;
-
-            auto value = convert<std::int64_t>(m.str(1) + m.str(2), cnv(base::dec)).value();
+    Lexer::Lexeme Lexer::ScanNumber(string_view str, size_t idx) {
+        size_t digits = idx;
+        char sign = str[idx];
+        if(sign == '+' || sign == '-') {
+            digits++;
+        }
 
-            return make_shared<DECIMAL_LITERAL>(FileName, CurrentLine, value, m.str(0).length());
-        } else {
-            return nullptr;
+        char first = At(str, digits);
+        if(!Is(first, CC_DEC)) {
+            return {};
         }
-    }
 
-    TokenPtr Lexer::IsHEX_LITERAL(std::string const & str) {
-        static regex re = regex(R"(([\+-]?)0[xX]([0-9a-fA-F]+))");
-        smatch m;
-        bool found = regex_search(str, m, re, rc::match_continuous);
-        if(found) {
+        size_t end = digits + 1;
+        Lexeme lex = {};
 
-            auto value = FromHex(m.str(2));
-            if(m.str(1) == "-") {
-                value *= -1;
+        if(first != '0') {
+            while(Is(At(str, end), CC_DEC)) {
+                end++;
             }
+            lex.Type = TokenType::DECIMAL_LITERAL;
 
-            return make_shared<HEX_LITERAL>(FileName, CurrentLine, value, m.str(0).length());
+            // A decimal literal has to fit an int64_t, -2^63 included
+            std::uint64_t magnitude = 0;
+            std::uint64_t limit = static_cast<std::uint64_t>(numeric_limits<std::int64_t>::max()) + (sign == '-' ? 1 : 0);
+            if(ParseUnsigned(str.substr(digits, end - digits), 10, magnitude) != std::errc{} || magnitude > limit) {
+                ThrowOutOfRange(str, idx, end - idx);
+            }
+            lex.Value = static_cast<std::int64_t>(sign == '-' ? 0 - magnitude : magnitude);
+        } else if(At(str, end) == 'b' && Is(At(str, end + 1), CC_BIN)) {
+            end++;
+            while(Is(At(str, end), CC_BIN)) {
+                end++;
+            }
+            lex.Type = TokenType::BINARY_LITERAL;
+            lex.Value = ScanBits(str, idx, digits + 2, end, 2);
+        } else if(ToUpper(At(str, end)) == 'X' && Is(At(str, end + 1), CC_HEX)) {
+            end++;
+            while(Is(At(str, end), CC_HEX)) {
+                end++;
+            }
+            lex.Type = TokenType::HEX_LITERAL;
+            lex.Value = ScanBits(str, idx, digits + 2, end, 16);
         } else {
-            return nullptr;
+            while(Is(At(str, end), CC_OCT)) {
+                end++;
+            }
+            lex.Type = TokenType::OCTAL_LITERAL;
+            lex.Value = ScanBits(str, idx, digits, end, 8);
+        }
+
+        if(sign == '-' && lex.Type != TokenType::DECIMAL_LITERAL) {
+            lex.Value = static_cast<std::int64_t>(0 - static_cast<std::uint64_t>(lex.Value));
         }
+        lex.Length = end - idx;
+        return lex;
     }
 
-    TokenPtr Lexer::IsCHAR_LITERAL(std::string const & str) {
-        size_t idx = 0;
-        if(str[idx++] != '\'') {
-            return nullptr;
+    std::int64_t Lexer::ScanBits(string_view str, size_t idx, size_t digits, size_t end, int base) {
+        std::uint64_t bits = 0;
+        if(ParseUnsigned(str.substr(digits, end - digits), base, bits) != std::errc{}) {
+            ThrowOutOfRange(str, idx, end - idx);
         }
+        return static_cast<std::int64_t>(bits);
+    }
+
+    void Lexer::ThrowOutOfRange(string_view str, size_t idx, size_t length) const {
+        // Lines aren't tracked while lexing, count them now that it failed
+        auto line = FirstLine + count(str.begin(), str.begin() + idx, '\n');
+        auto nl = str.rfind('\n', idx);
+        auto column = (nl == string_view::npos) ? idx : idx - nl - 1;
+        throw std::exception(
+            (
+                FileName + ":" + to_string(line + 1) + ":" + to_string(column + 1) + ": error: literal " +
+                string(str.substr(idx, length)) + " is out of range"
+            ).c_str()
+        );
+    }
+
+    Lexer::Lexeme Lexer::ScanCharLiteral(string_view str, size_t idx) {
+        char c = At(str, idx + 1);
 
-        auto tok = IsSIMPLE_CHAR(str.substr(idx));
-        if(tok != nullptr) {
-            idx++;
-            if(str[idx] != '\'') {
-                return nullptr;
+        if(IsSimpleChar(c)) {
+            if(At(str, idx + 2) != '\'') {
+                return {};
             }
-            return make_shared<CHAR_LITERAL>(FileName, CurrentLine, static_pointer_cast<SIMPLE_CHAR>(tok)->ch[0], 3);
+            return { TokenType::CHAR_LITERAL, 3, 1, 1, c };
         }
 
-        tok = IsESCAPED_HEX_CHAR(str.substr(idx));
-        if(tok != nullptr) {
-            idx++;
-            if(str[idx] != '\'') {
-                return nullptr;
-            }
-            using namespace boost;
-            using namespace boost::cnv;
-            static boost::cnv::cstream cnv;
+        if(c != '\\') {
+            return {};
+        }
 
-            auto c_s = static_pointer_cast<ESCAPED_HEX_CHAR>(tok)->ch.substr(2);
-            char c = (char)(convert<std::uint64_t>(c_s, cnv(base::hex)).value());
+        char e = At(str, idx + 2);
 
-            return make_shared<CHAR_LITERAL>(FileName, CurrentLine, c, 6);
+        if(e == 'x' && Is(At(str, idx + 3), CC_HEX) && Is(At(str, idx + 4), CC_HEX)) {
+            if(At(str, idx + 5) != '\'') {
+                return {};
+            }
+            auto value = (char)(DigitValue(At(str, idx + 3)) << 4 | DigitValue(At(str, idx + 4)));
+            return { TokenType::CHAR_LITERAL, 6, 1, 4, value };
         }
 
-        tok = IsESCAPED_OCTAL_CHAR(str.substr(idx));
-        if(tok != nullptr) {
-            idx++;
-            if(str[idx] != '\'') {
-                return nullptr;
+        if(Is(e, CC_OCT) && Is(At(str, idx + 3), CC_OCT) && Is(At(str, idx + 4), CC_OCT)) {
+            if(At(str, idx + 5) != '\'') {
+                return {};
             }
-            using namespace boost;
-            using namespace boost::cnv;
-            static boost::cnv::cstream cnv;
-
-            auto c_s = static_pointer_cast<ESCAPED_OCTAL_CHAR>(tok)->ch.substr(1);
-            char c = (char)(convert<std::uint64_t>(c_s, cnv(base::oct)).value());
-
-            return make_shared<CHAR_LITERAL>(FileName, CurrentLine, c, 6);
+            auto code = DigitValue(e) << 6 | DigitValue(At(str, idx + 3)) << 3 | DigitValue(At(str, idx + 4));
+            if(code > 0377) {
+                ThrowOutOfRange(str, idx, 6);
+            }
+            auto value = (char)code;
+            return { TokenType::CHAR_LITERAL, 6, 1, 4, value };
         }
 
-        tok = IsESCAPED_CONTROL_CHAR(str.substr(idx));
-        if(tok != nullptr) {
-            idx++;
-            if(str[idx] != '\'') {
-                return nullptr;
+        if(IsControlEscape(e)) {
+            if(At(str, idx + 3) != '\'') {
+                return {};
             }
 
-            auto c_s = static_pointer_cast<ESCAPED_CONTROL_CHAR>(tok)->ch.substr(1);
-            char c;
+            char value;
 
-            switch(c_s[0]) {
+            switch(e) {
             case 'a':
-                c = '\a';
+                value = '\a';
                 break;
             case 'b':
-                c = '\b';
+                value = '\b';
                 break;
             case 'f':
-                c = '\f';
+                value = '\f';
                 break;
             case 'n':
-                c = '\n';
+                value = '\n';
                 break;
             case 'r':
-                c = '\r';
+                value = '\r';
                 break;
             case 't':
-                c = '\t';
+                value = '\t';
                 break;
             case 'v':
-                c = '\v';
-                break;
-            case '\'':
-                c = '\'';
+                value = '\v';
                 break;
             case '0':
-                c = '\0';
+                value = '\0';
                 break;
-            case '\\':
-                c = '\\';
+            default: // '\'' and '\\' stand for themselves
+                value = e;
                 break;
             }
 
-            return make_shared<CHAR_LITERAL>(FileName, CurrentLine, c, 4);
+            return { TokenType::CHAR_LITERAL, 4, 1, 2, value };
+        }
+
+        return {};
+    }
+
+    TokenPtr Lexer::MakeToken(string_view str, size_t idx, Lexeme const& lex) {
+        auto text = [&]() { return string(str.substr(idx + lex.TextOffset, lex.TextLength)); };
+
+        switch(lex.Type) {
+        case TokenType::NEWLINE:
+            return make_shared<NEWLINE>(SourceLocation{}, FirstLine);
+        case TokenType::COLON:
+            return make_shared<COLON>(SourceLocation{}, FirstLine);
+        case TokenType::COMMA:
+            return make_shared<COMMA>(SourceLocation{}, FirstLine);
+        case TokenType::LEFT_BRACKET:
+            return make_shared<LEFT_BRACKET>(SourceLocation{}, FirstLine);
+        case TokenType::RIGHT_BRACKET:
+            return make_shared<RIGHT_BRACKET>(SourceLocation{}, FirstLine);
+        case TokenType::XPLUS:
+            return make_shared<XPLUS>(SourceLocation{}, FirstLine);
+        case TokenType::XMINUS:
+            return make_shared<XMINUS>(SourceLocation{}, FirstLine);
+        case TokenType::YPLUS:
+            return make_shared<YPLUS>(SourceLocation{}, FirstLine);
+        case TokenType::YMINUS:
+            return make_shared<YMINUS>(SourceLocation{}, FirstLine);
+        case TokenType::MNEMONIC:
+            return make_shared<MNEMONIC>(SourceLocation{}, FirstLine, static_cast<Opcode>(lex.Value));
+        case TokenType::WORD_SIZE:
+            return make_shared<WORD_SIZE>(SourceLocation{}, FirstLine, text());
+        case TokenType::REGISTER:
+            return make_shared<REGISTER>(SourceLocation{}, FirstLine, text());
+        case TokenType::IDENTIFIER:
+            return make_shared<IDENTIFIER>(SourceLocation{}, FirstLine, text());
+        case TokenType::LABEL:
+            return make_shared<LABEL>(SourceLocation{}, FirstLine, text(), lex.Length);
+        case TokenType::COMMENT:
+            return make_shared<COMMENT>(SourceLocation{}, FirstLine, text());
+        case TokenType::BINARY_LITERAL:
+            return make_shared<BINARY_LITERAL>(SourceLocation{}, FirstLine, lex.Value, lex.Length);
+        case TokenType::OCTAL_LITERAL:
+            return make_shared<OCTAL_LITERAL>(SourceLocation{}, FirstLine, lex.Value, lex.Length);
+        case TokenType::DECIMAL_LITERAL:
+            return make_shared<DECIMAL_LITERAL>(SourceLocation{}, FirstLine, lex.Value, lex.Length);
+        case TokenType::HEX_LITERAL:
+            return make_shared<HEX_LITERAL>(SourceLocation{}, FirstLine, lex.Value, lex.Length);
+        case TokenType::CHAR_LITERAL:
+            return make_shared<CHAR_LITERAL>(SourceLocation{}, FirstLine, (char)lex.Value, lex.Length);
+        default:
+            return nullptr;
         }
+    }
 
-        return nullptr;
+    TokenPtr Lexer::IsNEWLINE(string_view str) {
+        return (At(str, 0) == '\n') ? make_shared<NEWLINE>(SourceLocation{}, FirstLine) : nullptr;
     }
 
-    size_t Lexer::SkipWhitespace(std::string const & str) {
-        size_t idx = 0;
-        while((str[idx] == ' ') || // Ignore non-newline whitespace
-            (str[idx] == '\t') ||
-            (str[idx] == '\v') ||
-            (str[idx] == '\a') ||
-            (str[idx] == '\b') ||
-            (str[idx] == '\f') ||
-            (str[idx] == '\r')) {
+    TokenPtr Lexer::IsCOLON(string_view str) {
+        return (At(str, 0) == ':') ? make_shared<COLON>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsSEMICOLON(string_view str) {
+        return (At(str, 0) == ';') ? make_shared<SEMICOLON>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsNON_NEWLINE(string_view str) {
+        return (!str.empty() && str[0] != '\n') ? make_shared<NON_NEWLINE>(SourceLocation{}, FirstLine) : nullptr;
+    }
 
-            idx++;
+    TokenPtr Lexer::IsMNEMONIC(string_view str) {
+        auto ident = ScanIdentifier(str, 0);
+        auto op = FindOpcode(str.substr(0, ident.Length));
+        if(ident.Length == 0 || !op.has_value()) {
+            return nullptr;
         }
-        return idx;
+        return make_shared<MNEMONIC>(SourceLocation{}, FirstLine, *op);
     }
 
-    std::int64_t Lexer::FromBinary(std::string const& str) {
-        std::int64_t ret = 0;
+    TokenPtr Lexer::IsWORD_SIZE(string_view str) {
+        auto ident = ScanIdentifier(str, 0);
+        if(ident.Length == 0 || !IsWordIn(str, 0, ident.Length, WordSizes)) {
+            return nullptr;
+        }
+        return make_shared<WORD_SIZE>(SourceLocation{}, FirstLine, string(str.substr(0, ident.Length)));
+    }
 
-        for(char c : str) {
-            switch(c) {
-            case '0':
-                ret <<= 1;
-                ret &= 0xFFFFFFFFFFFFFFFE;
-                break;
-            case '1':
-                ret <<= 1;
-                ret |= 0x1;
-                break;
-            default:
-                throw std::exception("Not a binary digit");
-                break;
-            }
+    TokenPtr Lexer::IsCOMMA(string_view str) {
+        return (At(str, 0) == ',') ? make_shared<COMMA>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsREGISTER(string_view str) {
+        if(At(str, 0) != '$') {
+            return nullptr;
         }
+        auto lex = ScanRegister(str, 0);
+        return (lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
 
-        return ret;
+    TokenPtr Lexer::IsBINARY_DIGIT(string_view str) {
+        return Is(At(str, 0), CC_BIN) ? make_shared<BINARY_DIGIT>(SourceLocation{}, FirstLine, string(str.substr(0, 1))) : nullptr;
     }
 
-    std::int64_t Lexer::FromOctal(std::string const& str) {
-        std::int64_t ret = 0;
+    TokenPtr Lexer::IsOCTAL_DIGIT(string_view str) {
+        return Is(At(str, 0), CC_OCT) ? make_shared<OCTAL_DIGIT>(SourceLocation{}, FirstLine, string(str.substr(0, 1))) : nullptr;
+    }
 
-        for(char c : str) {
-            ret *= 8;
-            switch(c) {
-            case '0':
-                ret += 0;
-                break;
-            case '1':
-                ret++;
-                break;
-            case '2':
-                ret += 2;
-                break;
-            case '3':
-                ret += 3;
-                break;
-            case '4':
-                ret += 4;
-                break;
-            case '5':
-                ret += 5;
-                break;
-            case '6':
-                ret += 6;
-                break;
-            case '7':
-                ret += 7;
-                break;
-            default:
-                throw std::exception("Not an octal digit");
-                break;
-            }
+    TokenPtr Lexer::IsDECIMAL_DIGIT(string_view str) {
+        return Is(At(str, 0), CC_DEC) ? make_shared<DECIMAL_DIGIT>(SourceLocation{}, FirstLine, string(str.substr(0, 1))) : nullptr;
+    }
+
+    TokenPtr Lexer::IsHEX_DIGIT(string_view str) {
+        return Is(At(str, 0), CC_HEX) ? make_shared<HEX_DIGIT>(SourceLocation{}, FirstLine, string(str.substr(0, 1))) : nullptr;
+    }
+
+    TokenPtr Lexer::IsLEFT_BRACKET(string_view str) {
+        return (At(str, 0) == '[') ? make_shared<LEFT_BRACKET>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsRIGHT_BRACKET(string_view str) {
+        return (At(str, 0) == ']') ? make_shared<RIGHT_BRACKET>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsXPLUS(string_view str) {
+        return (ToUpper(At(str, 0)) == 'X' && At(str, 1) == '+') ? make_shared<XPLUS>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsXMINUS(string_view str) {
+        return (ToUpper(At(str, 0)) == 'X' && At(str, 1) == '-') ? make_shared<XMINUS>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsYPLUS(string_view str) {
+        return (ToUpper(At(str, 0)) == 'Y' && At(str, 1) == '+') ? make_shared<YPLUS>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsYMINUS(string_view str) {
+        return (ToUpper(At(str, 0)) == 'Y' && At(str, 1) == '-') ? make_shared<YMINUS>(SourceLocation{}, FirstLine) : nullptr;
+    }
+
+    TokenPtr Lexer::IsSIMPLE_CHAR(string_view str) {
+        return IsSimpleChar(At(str, 0)) ? make_shared<SIMPLE_CHAR>(SourceLocation{}, FirstLine, string(str.substr(0, 1))) : nullptr;
+    }
+
+    TokenPtr Lexer::IsESCAPED_CONTROL_CHAR(string_view str) {
+        if(At(str, 0) != '\\' || !IsControlEscape(At(str, 1))) {
+            return nullptr;
         }
-        return ret;
+        return make_shared<ESCAPED_CONTROL_CHAR>(SourceLocation{}, FirstLine, string(str.substr(0, 2)));
     }
 
-    std::int64_t Lexer::FromHex(std::string const& str) {
-        using namespace std;
-        static map<char, int64_t> hexm = {
-            { '0', 0x0 }, { '1', 0x1 }, { '2', 0x2 }, { '3', 0x3 }, { '4', 0x4 },
-            { '5', 0x5 }, { '6', 0x6 }, { '7', 0x7 }, { '8', 0x8 }, { '9', 0x9 },
-            { 'a', 0xa }, { 'b', 0xb }, { 'c', 0xc }, { 'd', 0xd }, { 'e', 0xe }, { 'f', 0xf },
-            { 'A', 0xa }, { 'B', 0xb }, { 'C', 0xc }, { 'D', 0xd }, { 'E', 0xe }, { 'F', 0xf },
-        };
-        std::int64_t ret = 0;
+    TokenPtr Lexer::IsESCAPED_OCTAL_CHAR(string_view str) {
+        if(At(str, 0) != '\\' || !Is(At(str, 1), CC_OCT) || !Is(At(str, 2), CC_OCT) || !Is(At(str, 3), CC_OCT)) {
+            return nullptr;
+        }
+        return make_shared<ESCAPED_OCTAL_CHAR>(SourceLocation{}, FirstLine, string(str.substr(0, 4)));
+    }
 
-        for(char c : str) {
-            ret *= 16;
-            ret += hexm[c];
+    TokenPtr Lexer::IsESCAPED_HEX_CHAR(string_view str) {
+        if(At(str, 0) != '\\' || At(str, 1) != 'x' || !Is(At(str, 2), CC_HEX) || !Is(At(str, 3), CC_HEX)) {
+            return nullptr;
         }
+        return make_shared<ESCAPED_HEX_CHAR>(SourceLocation{}, FirstLine, string(str.substr(0, 4)));
+    }
 
-        return ret;
+    TokenPtr Lexer::IsIDENTIFIER(std::string_view str) {
+        auto lex = ScanIdentifier(str, 0);
+        return (lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    TokenPtr Lexer::IsLABEL(std::string_view str) {
+        // This is slightly more complicated we scan for two tokens in sequence
+        auto ident = ScanIdentifier(str, 0);
+        if(ident.Length == 0) {
+            return nullptr;
+        }
+        auto lex = ScanLabel(str, 0, ident);
+        return (lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    TokenPtr Lexer::IsCOMMENT(std::string_view str) {
+        if(At(str, 0) != ';') {
+            return nullptr;
+        }
+        return MakeToken(str, 0, ScanComment(str, 0));
+    }
+
+    TokenPtr Lexer::IsBINARY_LITERAL(std::string_view str) {
+        auto lex = ScanNumber(str, 0);
+        return (lex.Type == TokenType::BINARY_LITERAL && lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    TokenPtr Lexer::IsOCTAL_LITERAL(std::string_view str) {
+        auto lex = ScanNumber(str, 0);
+        return (lex.Type == TokenType::OCTAL_LITERAL && lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    TokenPtr Lexer::IsDECIMAL_LITERAL(std::string_view str) {
+        auto lex = ScanNumber(str, 0);
+        return (lex.Type == TokenType::DECIMAL_LITERAL && lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    TokenPtr Lexer::IsHEX_LITERAL(std::string_view str) {
+        auto lex = ScanNumber(str, 0);
+        return (lex.Type == TokenType::HEX_LITERAL && lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    TokenPtr Lexer::IsCHAR_LITERAL(std::string_view str) {
+        if(At(str, 0) != '\'') {
+            return nullptr;
+        }
+        auto lex = ScanCharLiteral(str, 0);
+        return (lex.Length != 0) ? MakeToken(str, 0, lex) : nullptr;
+    }
+
+    size_t Lexer::SkipWhitespace(std::string_view str) {
+        return simd::SkipBlanks(str, 0);
+    }
+
+    std::int64_t Lexer::FromBinary(std::string_view str) {
+        return FromBase(str, 2, "Not a binary number");
+    }
+
+    std::int64_t Lexer::FromOctal(std::string_view str) {
+        return FromBase(str, 8, "Not an octal number");
+    }
+
+    std::int64_t Lexer::FromHex(std::string_view str) {
+        return FromBase(str, 16, "Not a hexadecimal number");
+    }
+
+    std::int64_t Lexer::FromBase(std::string_view str, int base, char const* what) {
+        std::uint64_t bits = 0;
+        auto ec = ParseUnsigned(str, base, bits);
+        if(ec == std::errc{}) {
+            return static_cast<std::int64_t>(bits);
+        } else if(ec == std::errc::result_out_of_range) {
+            throw std::exception("Number does not fit in 64 bits");
+        }
+        throw std::exception(what);
     }
 
     std::string ToString(std::vector<TokenPtr> const & tokens) {
@@ -0,0 +1,214 @@
+#include "stdafx.h"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+#include "Tokens.hpp"
+#include "TokenStream.hpp"
+#include "Lexer.hpp"
+#include "Nodes.hpp"
+#include "Parser.hpp"
+#include "Encoder.hpp"
+#include "ObjectFile.hpp"
+
+namespace npasm::object {
+
+    using namespace std;
+    using namespace npasm::lexer;
+    using namespace npasm::encoder;
+    using namespace npasm::object::layout;
+
+    namespace {
+
+        constexpr string_view CodeSectionName = "code";
+
+        std::uint64_t AlignUp(std::uint64_t offset) {
+            return (offset + Alignment - 1) & ~static_cast<std::uint64_t>(Alignment - 1);
+        }
+
+        template<typename T>
+        void Put(vector<std::uint8_t>& out, std::uint64_t offset, T const& record) {
+            memcpy(out.data() + offset, &record, sizeof(T));
+        }
+
+        /// Gathers the names into a string table, each followed by a NUL
+        class StringTableBuilder {
+        public:
+            NameRef Add(string_view name) {
+                auto ref = NameRef{ static_cast<std::uint32_t>(Text.size()), static_cast<std::uint32_t>(name.length()) };
+                Text += name;
+                Text += '\0';
+                return ref;
+            }
+
+            string Text;
+        };
+
+    }
+
+    std::vector<std::uint8_t> BuildObject(encoder::EncodeResult const& result) {
+        auto const& binary = result.Partial();
+        auto const& labels = result.Labels();
+        auto const& relocations = result.Relocations();
+
+        StringTableBuilder strings;
+        vector<SectionHeader> sections;
+        sections.push_back({ strings.Add(CodeSectionName), SectionCode, 1, 0, binary.size() });
+
+        vector<SymbolEntry> symbols;
+        symbols.reserve(labels.size());
+        for(auto const& label : labels.Symbols()) {
+            symbols.push_back({ strings.Add(label.Name), 0, label.Address });
+        }
+
+        // The labels of other units get a symbol each, the first time a relocation names them
+        SymbolTable imports;
+        vector<RelocationEntry> entries;
+        entries.reserve(relocations.size());
+        for(auto const& relocation : relocations) {
+            auto symbol = labels.IndexOf(relocation.Label);
+            if(symbol == SymbolTable::NotFound) {
+                if(auto known = imports.Find(relocation.Label)) {
+                    symbol = *known;
+                } else {
+                    symbol = symbols.size();
+                    imports.Insert(relocation.Label, static_cast<std::uint32_t>(symbol));
+                    symbols.push_back({ strings.Add(relocation.Label), UndefinedSection, 0 });
+                }
+            }
+            entries.push_back({ 0, relocation.Offset, static_cast<std::uint32_t>(symbol), relocation.Addend,
+                relocation.Relative ? RelocationKind::Relative32 : RelocationKind::Absolute32, {} });
+        }
+
+        auto header = ObjectHeader{};
+        memcpy(header.Magic, Magic, sizeof(Magic));
+        header.Version = FormatVersion;
+        header.HeaderSize = sizeof(ObjectHeader);
+        header.SectionCount = static_cast<std::uint32_t>(sections.size());
+        header.SymbolCount = static_cast<std::uint32_t>(symbols.size());
+        header.RelocationCount = static_cast<std::uint32_t>(entries.size());
+        header.SectionTable = sizeof(ObjectHeader);
+        header.SymbolTable = header.SectionTable + sections.size() * sizeof(SectionHeader);
+        header.RelocationTable = header.SymbolTable + symbols.size() * sizeof(SymbolEntry);
+        header.StringTable = header.RelocationTable + entries.size() * sizeof(RelocationEntry);
+        header.StringTableSize = static_cast<std::uint32_t>(strings.Text.size());
+
+        auto end = AlignUp(header.StringTable + header.StringTableSize);
+        for(auto& section : sections) {
+            section.Offset = end;
+            end = AlignUp(end + section.Size);
+        }
+        header.FileSize = end;
+
+        // The padding is zeros
+        vector<std::uint8_t> out(header.FileSize, 0);
+        Put(out, 0, header);
+        for(size_t idx = 0; idx < sections.size(); idx++) {
+            Put(out, header.SectionTable + idx * sizeof(SectionHeader), sections[idx]);
+        }
+        if(!symbols.empty()) {
+            memcpy(out.data() + header.SymbolTable, symbols.data(), symbols.size() * sizeof(SymbolEntry));
+        }
+        if(!entries.empty()) {
+            memcpy(out.data() + header.RelocationTable, entries.data(), entries.size() * sizeof(RelocationEntry));
+        }
+        memcpy(out.data() + header.StringTable, strings.Text.data(), strings.Text.size());
+        if(!binary.empty()) {
+            memcpy(out.data() + sections[0].Offset, binary.data(), binary.size());
+        }
+        return out;
+    }
+
+    ObjectFile ObjectFile::FromFile(std::string const& path) {
+        return ObjectFile(SourceBuffer::FromFile(path));
+    }
+
+    ObjectFile::ObjectFile(lexer::SourceBuffer::sptr buffer) : Buffer{std::move(buffer)} {
+        auto data = Buffer->Text();
+        if(reinterpret_cast<std::uintptr_t>(data.data()) % Alignment != 0) {
+            throw std::exception("Object file isn't aligned in memory");
+        }
+        if(data.length() < sizeof(ObjectHeader)) {
+            throw std::exception("Object file is truncated");
+        }
+
+        auto const& header = Header();
+        if(memcmp(header.Magic, Magic, sizeof(Magic)) != 0) {
+            throw std::exception("Not an object file");
+        }
+        if(header.Version != FormatVersion || header.HeaderSize != sizeof(ObjectHeader)) {
+            throw std::exception(("Unsupported object file version " + to_string(header.Version)).c_str());
+        }
+        if(header.FileSize != data.length()) {
+            throw std::exception("Object file is truncated");
+        }
+
+        SectionRecords = Table<SectionHeader>(header.SectionTable, header.SectionCount);
+        SymbolRecords = Table<SymbolEntry>(header.SymbolTable, header.SymbolCount);
+        RelocationRecords = Table<RelocationEntry>(header.RelocationTable, header.RelocationCount);
+        if(header.StringTable > data.length() || header.StringTableSize > data.length() - header.StringTable) {
+            throw std::exception("Object file string table is out of bounds");
+        }
+        Strings = data.substr(header.StringTable, header.StringTableSize);
+
+        for(auto const& section : SectionRecords) {
+            if(section.Offset > data.length() || section.Size > data.length() - section.Offset) {
+                throw std::exception("Object file section is out of bounds");
+            }
+        }
+
+        // A linker indexes the section table with these as they are
+        for(auto const& symbol : SymbolRecords) {
+            if(symbol.Section != UndefinedSection &&
+                (symbol.Section >= SectionRecords.size() || symbol.Value > SectionRecords[symbol.Section].Size)) {
+                throw std::exception("Object file symbol is out of bounds");
+            }
+        }
+        for(auto const& relocation : RelocationRecords) {
+            if(relocation.Section >= SectionRecords.size() ||
+                relocation.Offset > SectionRecords[relocation.Section].Size ||
+                RelocationFieldSize > SectionRecords[relocation.Section].Size - relocation.Offset) {
+                throw std::exception("Object file relocation is out of bounds");
+            }
+            if(relocation.Kind != RelocationKind::Absolute32 && relocation.Kind != RelocationKind::Relative32) {
+                throw std::exception("Object file relocation has an unknown kind");
+            }
+        }
+    }
+
+    template<typename T>
+    std::span<T const> ObjectFile::Table(std::uint64_t offset, std::uint64_t count) const {
+        auto length = Buffer->Text().length();
+        if(offset % Alignment != 0 || offset > length || count > (length - offset) / sizeof(T)) {
+            throw std::exception("Object file table is out of bounds");
+        }
+        return { At<T>(offset), static_cast<size_t>(count) };
+    }
+
+    std::string_view ObjectFile::Name(layout::NameRef name) const {
+        if(name.Offset > Strings.length() || name.Length > Strings.length() - name.Offset) {
+            throw std::exception("Object file name is out of bounds");
+        }
+        return Strings.substr(name.Offset, name.Length);
+    }
+
+    std::span<std::uint8_t const> ObjectFile::Data(layout::SectionHeader const& section) const {
+        return { At<std::uint8_t>(section.Offset), static_cast<size_t>(section.Size) };
+    }
+
+    layout::SymbolEntry const& ObjectFile::SymbolOf(layout::RelocationEntry const& relocation) const {
+        if(relocation.Symbol >= SymbolRecords.size()) {
+            throw std::exception(("Relocation names symbol " + to_string(relocation.Symbol) + ", which doesn't exist").c_str());
+        }
+        return SymbolRecords[relocation.Symbol];
+    }
+
+    layout::SymbolEntry const* ObjectFile::FindSymbol(std::string_view name) const {
+        for(auto const& symbol : SymbolRecords) {
+            if(Name(symbol.Name) == name) {
+                return &symbol;
+            }
+        }
+        return nullptr;
+    }
+
+}
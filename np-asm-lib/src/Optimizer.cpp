@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+#include "Tokens.hpp"
+#include "TokenStream.hpp"
+#include "Lexer.hpp"
+#include "Nodes.hpp"
+#include "Parser.hpp"
+#include "Optimizer.hpp"
+
+namespace npasm::optimizer {
+    using namespace std;
+    using namespace npasm::lexer;
+    using namespace npasm::parser;
+
+    namespace {
+
+        constexpr auto RegisterAcc = FindRegister("ACC")->Index;
+        constexpr auto RegisterA = FindRegister("A")->Index;
+        constexpr auto RegisterX = FindRegister("X")->Index;
+        constexpr auto RegisterY = FindRegister("Y")->Index;
+
+        /// The register `arg` is if it is a general purpose one
+        optional<RegisterId> PlainRegister(Program const& program, NodeRef<Argument> arg) {
+            if(auto reg = program.As<RegisterArgument>(arg)) {
+                auto id = FindRegister(reg->Value);
+                if(id && (id->Index == RegisterAcc || id->Index >= RegisterA)) {
+                    return id;
+                }
+            }
+            return nullopt;
+        }
+
+        bool SameRegister(RegisterId a, RegisterId b) {
+            return a.Index == b.Index && a.Part == b.Part;
+        }
+
+        /// Whether evaluating `arg` reads any part of register `index`
+        bool Reads(Program const& program, NodeRef<Argument> arg, std::uint8_t index) {
+            return visit(Overloaded{
+                [&](RegisterArgument const& reg) {
+                    auto id = FindRegister(reg.Value);
+                    return !id || id->Index == index;
+                },
+                [&](PointerArgument const& ptr) { return Reads(program, ptr.SubArgument, index); },
+                [&](XIndexArgument const& x) { return index == RegisterX || Reads(program, x.SubArgument, index); },
+                [&](YIndexArgument const& y) { return index == RegisterY || Reads(program, y.SubArgument, index); },
+                [&](IntegerArgument const&) { return false; },
+                [&](IdentifierArgument const&) { return false; },
+            }, program[arg]);
+        }
+
+        /// Whether two WordSizes as written are the same, `byte` and `BYTE` are
+        bool SameSize(string_view a, string_view b) {
+            auto lower = [](string_view size) { return size.empty() ? '\0' : static_cast<char>(size[0] | 0x20); };
+            return lower(a) == lower(b);
+        }
+
+    }
+
+    std::string_view ToString(PeepholeRule rule) {
+        switch(rule) {
+        case PeepholeRule::DeadMove: return "dead-move";
+        case PeepholeRule::IncChain: return "inc-chain";
+        case PeepholeRule::PushPop: return "push-pop";
+        case PeepholeRule::JumpToNext: return "jump-to-next";
+        }
+        return "unknown";
+    }
+
+    std::size_t Optimizer::Optimize(Program& program) {
+        Rewrites = 0;
+        Run.clear();
+
+        for(size_t idx = 0; idx < program.Lines.size(); idx++) {
+            auto& line = program.Lines[idx];
+            if(line.Label) {
+                Run.clear();
+            }
+            if(!line.Instruction) {
+                continue;
+            }
+            if(JumpsToNext(program, idx)) {
+                line.Instruction = {};
+                Hit(PeepholeRule::JumpToNext);
+                continue;
+            }
+
+            // Dropping the previous instruction may leave one before it that combines with this one
+            auto kept = true;
+            while(kept && !Run.empty()) {
+                auto outcome = Combine(program, program.Lines[Run.back()], line);
+                if(outcome == Outcome::None) {
+                    break;
+                }
+                if(outcome == Outcome::DroppedPrevious || outcome == Outcome::DroppedBoth) {
+                    Run.pop_back();
+                }
+                kept = outcome == Outcome::DroppedPrevious;
+            }
+            if(kept) {
+                Run.push_back(idx);
+            }
+        }
+
+        return Rewrites;
+    }
+
+    Optimizer::Outcome Optimizer::Combine(Program& program, Line& previous, Line& current) {
+        auto& prev = program[previous.Instruction];
+        auto& cur = program[current.Instruction];
+        if(!SameSize(prev.WordSize, cur.WordSize)) {
+            return Outcome::None;
+        }
+
+        if(prev.Mnemonic == Opcode::PUSH && cur.Mnemonic == Opcode::POP) {
+            previous.Instruction = {};
+            current.Instruction = {};
+            Hit(PeepholeRule::PushPop);
+            return Outcome::DroppedBoth;
+        }
+
+        if(prev.Mnemonic == Opcode::MOVE && cur.Mnemonic == Opcode::MOVE) {
+            auto target = PlainRegister(program, prev.Arguments[0]);
+            auto overwrite = PlainRegister(program, cur.Arguments[0]);
+            if(target && overwrite && SameRegister(*target, *overwrite) && !Reads(program, cur.Arguments[1], target->Index)) {
+                previous.Instruction = {};
+                Hit(PeepholeRule::DeadMove);
+                return Outcome::DroppedPrevious;
+            }
+            return Outcome::None;
+        }
+
+        if(cur.Mnemonic == Opcode::INC || cur.Mnemonic == Opcode::DEC) {
+            auto step = cur.Mnemonic;
+            auto sum = step == Opcode::INC ? Opcode::ADD : Opcode::SUB;
+            auto reg = PlainRegister(program, cur.Arguments[0]);
+            auto target = PlainRegister(program, prev.Arguments[0]);
+            if(!reg || !target || !SameRegister(*reg, *target)) {
+                return Outcome::None;
+            }
+
+            if(prev.Mnemonic == step) {
+                prev.Mnemonic = sum;
+                prev.ArgumentCount = 2;
+                prev.Arguments[1] = program.Add(Argument{ IntegerArgument{ 2 } });
+            } else if(auto amount = prev.Mnemonic == sum ? program.As<IntegerArgument>(prev.Arguments[1]) : nullptr;
+                amount && amount->Value >= 0 && amount->Value < numeric_limits<std::int32_t>::max()) {
+                get<IntegerArgument>(program[prev.Arguments[1]]).Value++;
+            } else {
+                return Outcome::None;
+            }
+            current.Instruction = {};
+            Hit(PeepholeRule::IncChain);
+            return Outcome::DroppedCurrent;
+        }
+
+        return Outcome::None;
+    }
+
+    bool Optimizer::JumpsToNext(Program const& program, std::size_t line) const {
+        auto const& inst = program[program.Lines[line].Instruction];
+        if(inst.Mnemonic != Opcode::JUMP && inst.Mnemonic != Opcode::JUMPC) {
+            return false;
+        }
+        auto target = program.As<IdentifierArgument>(inst.Arguments[0]);
+        if(target == nullptr) {
+            return false;
+        }
+
+        // Any labels between here and the next instruction all point at it
+        for(auto next = line + 1; next < program.Lines.size(); next++) {
+            auto const& after = program.Lines[next];
+            if(after.Label && program[after.Label].Value == target->Value) {
+                return true;
+            }
+            if(after.Instruction) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+}
@@ -1,236 +1,712 @@
 #include "stdafx.h"
+#include "Parallel.hpp"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
 #include "Tokens.hpp"
+#include "TokenStream.hpp"
+#include "Lexer.hpp"
 #include "Nodes.hpp"
 #include "Parser.hpp"
 
 namespace npasm::parser {
     using namespace std;
-    using namespace boost::locale;
     using namespace npasm::lexer;
 
-    Parser::Parser() : LastError{""} { }
+    Parser::Parser() : Furthest{}, Target{nullptr} { }
 
     Parser::~Parser() { }
 
-    Program::sptr Parser::Parse(TokenList const & tokens) {
-        return ParseProgram(tokens);
+    ParseResult Parser::TryParse(TokenList const & tokens, std::size_t threads) {
+        return ParseProgram(tokens, threads);
     }
 
-    Program::sptr Parser::ParseProgram(TokenList const & tokens) {
-        auto program = Program::sptr{new Program()};
+    Program::sptr Parser::Parse(TokenList const & tokens, std::size_t threads) {
+        return ParseProgram(tokens, threads).Value();
+    }
+
+    namespace {
+
+        /// Where the pools of a piece start in the joined Program
+        struct PoolBases {
+            std::uint32_t Lines = 0;
+            std::uint32_t Labels = 0;
+            std::uint32_t Instructions = 0;
+            std::uint32_t Comments = 0;
+            std::uint32_t Arguments = 0;
+        };
+
+        template<class T>
+        inline NodeRef<T> Rebase(NodeRef<T> ref, std::uint32_t base) {
+            return ref.IsValid() ? NodeRef<T>{ref.Index + base} : ref;
+        }
+
+        /// Copies the nodes of `part` into `into` at `at`, moving their references along
+        void CopyPart(Program const& part, Program& into, PoolBases const& at) {
+            for(size_t idx = 0; idx < part.Lines.size(); idx++) {
+                auto line = part.Lines[idx];
+                line.Label = Rebase(line.Label, at.Labels);
+                line.Instruction = Rebase(line.Instruction, at.Instructions);
+                line.Comment = Rebase(line.Comment, at.Comments);
+                into.Lines[at.Lines + idx] = line;
+            }
+            for(size_t idx = 0; idx < part.Labels.size(); idx++) {
+                into.Labels[at.Labels + idx] = part.Labels[idx];
+            }
+            for(size_t idx = 0; idx < part.Comments.size(); idx++) {
+                into.Comments[at.Comments + idx] = part.Comments[idx];
+            }
+            for(size_t idx = 0; idx < part.Instructions.size(); idx++) {
+                auto inst = part.Instructions[idx];
+                for(auto& arg : inst.Arguments) {
+                    arg = Rebase(arg, at.Arguments);
+                }
+                into.Instructions[at.Instructions + idx] = inst;
+            }
+            for(size_t idx = 0; idx < part.Arguments.size(); idx++) {
+                auto arg = part.Arguments[idx];
+                visit(Overloaded{
+                    [](RegisterArgument&) { },
+                    [](IntegerArgument&) { },
+                    [](IdentifierArgument&) { },
+                    [&](PointerArgument& ptr) { ptr.SubArgument = Rebase(ptr.SubArgument, at.Arguments); },
+                    [&](XIndexArgument& x) { x.SubArgument = Rebase(x.SubArgument, at.Arguments); },
+                    [&](YIndexArgument& y) { y.SubArgument = Rebase(y.SubArgument, at.Arguments); },
+                }, arg);
+                into.Arguments[at.Arguments + idx] = arg;
+            }
+        }
+
+    }
+
+    ParseResult Parser::ParseProgram(TokenList const & tokens, std::size_t threads) {
+        auto program = make_shared<Program>();
+        program->Source = tokens.Buffer();
+        vector<Diagnostic> errors;
+
+        if(threads == 0) {
+            threads = max<size_t>(thread::hardware_concurrency(), 1);
+        }
+        threads = min(threads, max<size_t>(tokens.size() / MinParallelTokens, 1));
+        if(threads <= 1) {
+            Reserve(*program, tokens.size());
+            ParseLines(tokens, 0, tokens.size(), *program, errors);
+            return ParseResult(program, move(errors), tokens.FileName());
+        }
+
+        // Cut just after the first NEWLINE past each even split
+        size_t pieces = min(threads * PiecesPerThread, max<size_t>(tokens.size() / MinParallelTokens, 1));
+        vector<size_t> bounds = { 0 };
+        for(size_t i = 1; i < pieces; i++) {
+            size_t cut = max(tokens.size() / pieces * i, bounds.back());
+            while(cut < tokens.size() && tokens.Type(cut) != TokenType::NEWLINE) {
+                cut++;
+            }
+            if(cut + 1 >= tokens.size()) {
+                break;
+            }
+            bounds.push_back(cut + 1);
+        }
+        bounds.push_back(tokens.size());
+        size_t count = bounds.size() - 1;
+
+        vector<Program> parts(count);
+        vector<vector<Diagnostic>> part_errors(count);
+
+        ParallelFor(count, threads, [&](size_t part) {
+            auto parser = Parser();
+            Reserve(parts[part], bounds[part + 1] - bounds[part]);
+            parser.ParseLines(tokens, bounds[part], bounds[part + 1], parts[part], part_errors[part]);
+        });
+
+        // Work out where each part lands in the joined pools
+        vector<PoolBases> at(count + 1);
+        for(size_t part = 0; part < count; part++) {
+            auto const& from = parts[part];
+            at[part + 1] = PoolBases{
+                static_cast<std::uint32_t>(at[part].Lines + from.Lines.size()),
+                static_cast<std::uint32_t>(at[part].Labels + from.Labels.size()),
+                static_cast<std::uint32_t>(at[part].Instructions + from.Instructions.size()),
+                static_cast<std::uint32_t>(at[part].Comments + from.Comments.size()),
+                static_cast<std::uint32_t>(at[part].Arguments + from.Arguments.size()),
+            };
+            errors.insert(errors.end(), part_errors[part].begin(), part_errors[part].end());
+        }
+
+        program->Lines.Resize(at[count].Lines);
+        program->Labels.Resize(at[count].Labels);
+        program->Instructions.Resize(at[count].Instructions);
+        program->Comments.Resize(at[count].Comments);
+        program->Arguments.Resize(at[count].Arguments);
+        ParallelFor(count, threads, [&](size_t part) {
+            CopyPart(parts[part], *program, at[part]);
+        });
+
+        return ParseResult(program, move(errors), tokens.FileName());
+    }
+
+    ParseResult Parser::ParseFused(Lexer& lexer, std::string const& file_name, SourceBuffer::sptr source) {
+        auto window = lexer.BeginLines(file_name, source);
+        return ParseFused(lexer, window);
+    }
+
+    ParseResult Parser::ParseFused(Lexer& lexer, SourceManager const& sources, FileId file) {
+        auto window = lexer.BeginLines(sources, file);
+        return ParseFused(lexer, window);
+    }
+
+    ParseResult Parser::ParseFused(Lexer& lexer, TokenStream& window) {
+        auto program = make_shared<Program>();
+        program->Source = window.Buffer();
+        vector<Diagnostic> errors;
+
+        // Typical code has about a token per ten bytes
+        auto length = window.Source().length();
+        Reserve(*program, length / 10);
+
+        for(size_t offset = 0; offset < length;) {
+            offset = lexer.LexLines(window, offset, FusedBatchBytes);
+            ParseLines(window, 0, window.size(), *program, errors);
+        }
+
+        return ParseResult(program, move(errors), window.FileName());
+    }
+
+    void Parser::Reserve(Program& program, std::size_t tokens) {
+        // Typical code has about four tokens per line and three per argument
+        program.Lines.Reserve(tokens / 4);
+        program.Instructions.Reserve(tokens / 4);
+        program.Arguments.Reserve(tokens / 3);
+    }
+
+    void Parser::ParseLines(TokenList const & tokens, std::size_t first, std::size_t last, Program& program,
+        std::vector<Diagnostic>& errors) {
 
-        for(auto iter = std::begin(tokens);
-            iter != std::end(tokens);) {
+        Target = &program;
 
-            LastError = "";
+        for(size_t iter = first;
+            iter != last;) {
 
-            if(auto [line, next] = ParseLine(tokens, iter); line != nullptr) {
-                program->Lines.push_back(line);
+            Furthest = Failure{iter, DiagnosticCode::UnexpectedToken, 0, Opcode{}};
+
+            if(auto [line, next] = ParseLine(tokens, iter); line) {
                 iter = next;
             } else {
-                if(iter != std::end(tokens)) {
-                    throw std::exception(
-                        (
-                            "PARSER: Unable to parse line " +
-                            string((*iter)->FileName) + ":" +
-                            to_string((*iter)->LineNumber) + "\n" +
-                            LastError
-                       ).c_str()
-                    );
-                } else {
-                    throw std::exception(
-                        (
-                            "PARSER: Unable to parse line\n" +
-                            LastError
-                        ).c_str()
-                    );
+                errors.push_back(MakeDiagnostic(tokens));
+
+                // Recover at the start of the next line
+                while(iter != last && tokens.Type(iter) != TokenType::NEWLINE) {
+                    iter++;
+                }
+                if(iter != last) {
+                    iter++;
                 }
             }
         }
 
-        return program;
+        Target = nullptr;
+    }
+
+    void Parser::Expect(std::size_t cpos, TokenType type) {
+        if(Furthest.Code != DiagnosticCode::UnexpectedToken) { // A rejection already doomed the line
+            return;
+        }
+        auto bit = uint64_t{1} << static_cast<unsigned>(type);
+        if(cpos > Furthest.Position) {
+            Furthest = Failure{cpos, DiagnosticCode::UnexpectedToken, bit, Opcode{}};
+        } else if(cpos == Furthest.Position) {
+            Furthest.Expected |= bit;
+        }
+    }
+
+    void Parser::Reject(std::size_t cpos, DiagnosticCode code, Opcode mnemonic) {
+        // Tokens that were accepted but aren't allowed there explain the failure
+        // better than whatever the alternatives expected, so the first one wins
+        if(Furthest.Code == DiagnosticCode::UnexpectedToken) {
+            Furthest = Failure{cpos, code, 0, mnemonic};
+        }
+    }
+
+    Diagnostic Parser::MakeDiagnostic(TokenList const & tokens) const {
+        auto diagnostic = Diagnostic{};
+        diagnostic.Code = Furthest.Code;
+        diagnostic.Expected = Furthest.Expected;
+        diagnostic.Mnemonic = Furthest.Mnemonic;
+
+        // A line only fails when there are tokens, so the first one anchors
+        // offsets past the last token to a location and a line number
+        auto const& source = *tokens.Buffer();
+        if(Furthest.Position < tokens.size()) {
+            diagnostic.Offset = tokens.Offset(Furthest.Position);
+            diagnostic.Location = tokens.Location(Furthest.Position);
+            diagnostic.Found = tokens.Type(Furthest.Position);
+        } else {
+            diagnostic.Offset = static_cast<uint32_t>(source.Text().size());
+            if(auto first = tokens.Location(0); first.IsValid()) {
+                diagnostic.Location = first + (diagnostic.Offset - tokens.Offset(0));
+            }
+        }
+
+        auto line = source.LineOf(diagnostic.Offset);
+        diagnostic.Line = tokens.Line(0) - source.LineOf(tokens.Offset(0)) + line;
+        diagnostic.Column = diagnostic.Offset - static_cast<uint32_t>(source.LineStart(line));
+        return diagnostic;
     }
 
-    Parser::ParseReturn<Line::sptr> Parser::ParseLine(TokenList const & tokens, TokenList::const_iterator cpos) {
-        auto line = Line::sptr{new Line()};
+    namespace {
+
+        /// Checks whether `cpos` points at a token of the given type
+        inline bool IsAt(Parser::TokenList const& tokens, std::size_t cpos, TokenType type) {
+            return (cpos < tokens.size()) && (tokens.Type(cpos) == type);
+        }
+
+    }
 
-        if(auto[label, next] = ParseLabel(tokens, cpos); label != nullptr) {
-            line->Label = label;
+    Parser::ParseReturn<NodeRef<Line>> Parser::ParseLine(TokenList const & tokens, std::size_t cpos) {
+        auto extent = Target->Size();
+        auto line = Line{};
+        line.Offset = (cpos < tokens.size()) ? tokens.Offset(cpos) : static_cast<std::uint32_t>(tokens.Source().length());
+
+        if(auto[label, next] = ParseLabel(tokens, cpos); label) {
+            line.Label = label;
             cpos = next;
         }
 
-        if(auto[instruction, next] = ParseInstruction(tokens, cpos); instruction != nullptr) {
-            line->Instruction = instruction;
+        if(auto[instruction, next] = ParseInstruction(tokens, cpos); instruction) {
+            line.Instruction = instruction;
             cpos = next;
         }
 
-        if(auto[comment, next] = ParseComment(tokens, cpos); comment != nullptr) {
-            line->Comment = comment;
+        if(auto[comment, next] = ParseComment(tokens, cpos); comment) {
+            line.Comment = comment;
             cpos = next;
         }
 
-        if(auto newline = *cpos; newline->Type != TokenType::NEWLINE) {
-            LastError += "Unable to parse Newline\n";
-            return std::make_tuple(nullptr, cpos);
+        if(cpos == tokens.size()) { // The last line doesn't need a Newline
+            return std::make_tuple(Target->Add(line), cpos);
         }
 
-        return std::make_tuple(line, cpos);
-    }
+        if(tokens.Type(cpos) != TokenType::NEWLINE) {
+            Expect(cpos, TokenType::NEWLINE);
+            Target->Truncate(extent);
+            return std::make_tuple(NodeRef<Line>{}, cpos);
+        }
+        cpos++;
 
-    Parser::ParseReturn<Label::sptr> Parser::ParseLabel(TokenList const & tokens, TokenList::const_iterator cpos) {
-        auto tok = *cpos;
+        return std::make_tuple(Target->Add(line), cpos);
+    }
 
-        if(tok->Type == TokenType::LABEL) {
-            auto label_tok = static_pointer_cast<LABEL>(tok);
-            auto label = Label::sptr(new Label(label_tok->label));
+    Parser::ParseReturn<NodeRef<Label>> Parser::ParseLabel(TokenList const & tokens, std::size_t cpos) {
+        if(IsAt(tokens, cpos, TokenType::LABEL)) {
+            auto label = Target->Add(Label{tokens.Text(cpos)});
             cpos++;
             return make_tuple(label, cpos);
         } else {
-            LastError += "Unable to parse Label\n";
-            return make_tuple(nullptr, cpos);
-        }
-    }
-
-    const set<std::string> NoArgOps = {
-        "nop", "pop", "ret", "iret", "iqe", "iqd", "ion", "ioff", "halt"
-    };
-    const set<std::string> OneArgOps = {
-        "inc", "dec", "cmpz", "cmpnz", "stack", "push",
-        "jump", "call", "jumpc", "callc", "int", "irset",
-        "hwnum", "hwqry", "hwint"
-    };
-    const set<std::string> TwoArgOps = {
-        "move", "swap", "add", "sub", "mul", "muls", "div", "divs",
-        "mod", "mods", "and", "bor", "xor", "shr", "shra", "shl",
-        "cmpeq", "cmpne", "cmpgt", "cmplt", "cmpge", "cmple",
-        "cmpgts", "cmplts", "cmpges", "cmples", "iset", "hwin",
-        "hwout"
-    };
-    const set<std::string> OpsWithoutSize = {
-        "nop", "jump", "call", "ret", "jumpc", "callc",
-        "iret", "iqe", "iqd", "ion", "ioff", "hwqry", "halt"
-    };
-
-    Parser::ParseReturn<Instruction::sptr> Parser::ParseInstruction(TokenList const & tokens, TokenList::const_iterator cpos) {
-        auto tok = *cpos;
-
-        auto[mnemonic, next] = ParseMnemonic(tokens, cpos);
-        if(mnemonic == nullptr) {
-            LastError += "Unable to parse Instruction\n";
-            return make_tuple(nullptr, cpos);
-        }
-        cpos = next;
-        auto mnemonic_str = to_lower(mnemonic->Value);
-
-        auto[word_size, next] = ParseWordSize(tokens, cpos);
-        if(word_size != nullptr) { // If it has a WordSize
-            cpos = next;
-            if(OpsWithoutSize.count(mnemonic_str) != 0) { // And Shouldn't have one
-                // Malformed instruction
-                LastError += "Word Size given for an instruction that doesn't need it (" + mnemonic_str + " | " + to_lower(word_size->Value) + ")\n";
-                return make_tuple(nullptr, cpos);
-            } else { // Does have one
-                // Nothing extra to do we fall out to the next step
-            }
-        } else { // No Word Size
-            // Everything can ommit a Word Size
-        }
-
-        if(NoArgOps.count(mnemonic_str) != 0) { // No arg opcode
-            if(auto[inst, next] = ParseNoArgumentInstruction(tokens, cpos); inst != nullptr) {
-                inst->Mnemonic = mnemonic;
-                inst->WordSize = word_size;
-                cpos = next;
-                return make_tuple(inst, cpos);
-            } else {
-                LastError += "Unable to parse No-Argument instruction (" + mnemonic_str + ")\n";
-                return make_tuple(nullptr, cpos);
-            }
-        } else if(OneArgOps.count(mnemonic_str) != 0) { // One arg opcode
-            if(auto[inst, next] = ParseOneArgumentInstruction(tokens, cpos); inst != nullptr) {
-                inst->Mnemonic = mnemonic;
-                inst->WordSize = word_size;
-                cpos = next;
-                return make_tuple(inst, cpos);
-            } else {
-                LastError += "Unable to parse One-Argument instruction (" + mnemonic_str + ")\n";
-                return make_tuple(nullptr, cpos);
-            }
-        } else if(TwoArgOps.count(mnemonic_str) != 0) { // Two arg opcode
-            if(auto[inst, next] = ParseTwoArgumentInstruction(tokens, cpos); inst != nullptr) {
-                inst->Mnemonic = mnemonic;
-                inst->WordSize = word_size;
-                cpos = next;
-                return make_tuple(inst, cpos);
-            } else {
-                LastError += "Unable to parse Two-Argument instruction (" + mnemonic_str + ")\n";
-                return make_tuple(nullptr, cpos);
+            Expect(cpos, TokenType::LABEL);
+            return make_tuple(NodeRef<Label>{}, cpos);
+        }
+    }
+
+    Parser::ParseReturn<NodeRef<Instruction>> Parser::ParseInstruction(TokenList const & tokens, std::size_t cpos) {
+        auto[mnemonic, after_mnemonic] = ParseMnemonic(tokens, cpos);
+        if(!mnemonic.has_value()) {
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+        cpos = after_mnemonic;
+        auto const& info = GetOpcodeInfo(*mnemonic);
+
+        string_view word_size;
+        if(info.HasWordSize) { // Everything can ommit a Word Size
+            size_t after_word_size;
+            tie(word_size, after_word_size) = ParseWordSize(tokens, cpos);
+            cpos = after_word_size;
+        } else if(IsAt(tokens, cpos, TokenType::WORD_SIZE)) { // Malformed instruction
+            Reject(cpos, DiagnosticCode::WordSizeNotAllowed, *mnemonic);
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+
+        NodeRef<Instruction> inst;
+        size_t next = cpos;
+        switch(info.Arity) {
+        case 0: // No arg opcode
+            tie(inst, next) = ParseNoArgumentInstruction(cpos);
+            if(!inst) {
+                return make_tuple(NodeRef<Instruction>{}, cpos);
+            }
+            break;
+        case 1: // One arg opcode
+            tie(inst, next) = ParseOneArgumentInstruction(tokens, cpos);
+            if(!inst) {
+                return make_tuple(NodeRef<Instruction>{}, cpos);
+            }
+            break;
+        case 2: // Two arg opcode
+            tie(inst, next) = ParseTwoArgumentInstruction(tokens, cpos);
+            if(!inst) {
+                return make_tuple(NodeRef<Instruction>{}, cpos);
+            }
+            break;
+        default: // Unknown arity
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+
+        (*Target)[inst].Mnemonic = *mnemonic;
+        (*Target)[inst].WordSize = word_size;
+        return make_tuple(inst, next);
+    }
+
+    Parser::ParseReturn<NodeRef<Comment>> Parser::ParseComment(TokenList const & tokens, std::size_t cpos) {
+        if(IsAt(tokens, cpos, TokenType::COMMENT)) {
+            auto comment = Target->Add(Comment{tokens.Text(cpos)});
+            cpos++;
+            return make_tuple(comment, cpos);
+        } else {
+            Expect(cpos, TokenType::COMMENT);
+            return make_tuple(NodeRef<Comment>{}, cpos);
+        }
+    }
+
+    Parser::ParseReturn<NodeRef<Instruction>> Parser::ParseTwoArgumentInstruction(TokenList const & tokens, std::size_t cpos) {
+        auto extent = Target->Size();
+        auto[arg1, after_arg1] = ParseArgument(tokens, cpos);
+        if(!arg1) {
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+        if(!IsAt(tokens, after_arg1, TokenType::COMMA)) {
+            Expect(after_arg1, TokenType::COMMA);
+            Target->Truncate(extent);
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+        auto[arg2, after_arg2] = ParseArgument(tokens, after_arg1 + 1);
+        if(!arg2) {
+            Target->Truncate(extent);
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+        auto inst = Target->Add(Instruction{ Opcode{}, {}, 2, { arg1, arg2 } });
+        return make_tuple(inst, after_arg2);
+    }
+
+    Parser::ParseReturn<NodeRef<Instruction>> Parser::ParseOneArgumentInstruction(TokenList const & tokens, std::size_t cpos) {
+        auto[arg, next] = ParseArgument(tokens, cpos);
+        if(!arg) {
+            return make_tuple(NodeRef<Instruction>{}, cpos);
+        }
+        auto inst = Target->Add(Instruction{ Opcode{}, {}, 1, { arg, {} } });
+        return make_tuple(inst, next);
+    }
+
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseIdentifierArgument(TokenList const & tokens, std::size_t cpos) {
+        if(IsAt(tokens, cpos, TokenType::IDENTIFIER)) {
+            auto arg = Target->Add(Argument{IdentifierArgument{tokens.Text(cpos)}});
+            cpos++;
+            return make_tuple(arg, cpos);
+        } else {
+            Expect(cpos, TokenType::IDENTIFIER);
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+    }
+
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseIntegerArgument(TokenList const & tokens, std::size_t cpos) {
+        auto type = cpos < tokens.size() ? tokens.Type(cpos) : TokenType::NEWLINE;
+        switch(type) {
+        case TokenType::BINARY_LITERAL:
+        case TokenType::OCTAL_LITERAL:
+        case TokenType::DECIMAL_LITERAL:
+        case TokenType::HEX_LITERAL:
+        case TokenType::CHAR_LITERAL:
+            break;
+        default:
+            for(auto literal : { TokenType::BINARY_LITERAL, TokenType::OCTAL_LITERAL, TokenType::DECIMAL_LITERAL,
+                TokenType::HEX_LITERAL, TokenType::CHAR_LITERAL }) {
+                Expect(cpos, literal);
             }
-        } else { // Unknown mnemonic
-            LastError += "Unknown Mnemonic (" + mnemonic_str + ")\n";
-            return make_tuple(nullptr, cpos);
+            return make_tuple(NodeRef<Argument>{}, cpos);
         }
+
+        auto value = tokens.Value(cpos);
+        cpos++;
+        return make_tuple(Target->Add(Argument{IntegerArgument{value}}), cpos);
     }
 
-    Parser::ParseReturn<Comment::sptr> Parser::ParseComment(TokenList const & tokens, TokenList::const_iterator cpos) {
-        auto tok = *cpos;
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseImmediateArgument(TokenList const & tokens, std::size_t cpos) {
+        if(auto[arg, next] = ParseIntegerArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        if(auto[arg, next] = ParseIdentifierArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        return make_tuple(NodeRef<Argument>{}, cpos);
+    }
 
-        if(tok->Type == TokenType::COMMENT) {
-            // TODO: Finish
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseRegisterArgument(TokenList const & tokens, std::size_t cpos) {
+        if(IsAt(tokens, cpos, TokenType::REGISTER)) {
+            auto arg = Target->Add(Argument{RegisterArgument{tokens.Text(cpos)}});
+            cpos++;
+            return make_tuple(arg, cpos);
+        } else {
+            Expect(cpos, TokenType::REGISTER);
+            return make_tuple(NodeRef<Argument>{}, cpos);
         }
     }
 
-    Parser::ParseReturn<TwoArgumentInstruction::sptr> Parser::ParseTwoArgumentInstruction(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<TwoArgumentInstruction::sptr>();
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseYIndexArgument(TokenList const & tokens, std::size_t cpos) {
+        bool plus = IsAt(tokens, cpos, TokenType::YPLUS);
+        if(!plus && !IsAt(tokens, cpos, TokenType::YMINUS)) {
+            Expect(cpos, TokenType::YPLUS);
+            Expect(cpos, TokenType::YMINUS);
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+        if(auto[reg, next] = ParseRegisterArgument(tokens, cpos + 1); reg) {
+            return make_tuple(Target->Add(Argument{YIndexArgument{plus, reg}}), next);
+        }
+        if(auto[imm, next] = ParseImmediateArgument(tokens, cpos + 1); imm) {
+            return make_tuple(Target->Add(Argument{YIndexArgument{plus, imm}}), next);
+        }
+        return make_tuple(NodeRef<Argument>{}, cpos);
     }
 
-    Parser::ParseReturn<OneArgumentInstruction::sptr> Parser::ParseOneArgumentInstruction(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<OneArgumentInstruction::sptr>();
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseXIndexArgument(TokenList const & tokens, std::size_t cpos) {
+        bool plus = IsAt(tokens, cpos, TokenType::XPLUS);
+        if(!plus && !IsAt(tokens, cpos, TokenType::XMINUS)) {
+            Expect(cpos, TokenType::XPLUS);
+            Expect(cpos, TokenType::XMINUS);
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+        if(auto[reg, next] = ParseRegisterArgument(tokens, cpos + 1); reg) {
+            return make_tuple(Target->Add(Argument{XIndexArgument{plus, reg}}), next);
+        }
+        if(auto[imm, next] = ParseImmediateArgument(tokens, cpos + 1); imm) {
+            return make_tuple(Target->Add(Argument{XIndexArgument{plus, imm}}), next);
+        }
+        return make_tuple(NodeRef<Argument>{}, cpos);
     }
 
-    Parser::ParseReturn<IdentifierArgument::sptr> Parser::ParseIdentifierArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<IdentifierArgument::sptr>();
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParsePointerArgument(TokenList const & tokens, std::size_t cpos) {
+        if(!IsAt(tokens, cpos, TokenType::LEFT_BRACKET)) {
+            Expect(cpos, TokenType::LEFT_BRACKET);
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+
+        auto extent = Target->Size();
+        auto[sub_arg, next] = ParseArgument(tokens, cpos + 1);
+        if(!sub_arg) {
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+        if(holds_alternative<PointerArgument>((*Target)[sub_arg])) { // Pointers don't nest
+            Reject(cpos + 1, DiagnosticCode::NestedPointer);
+            Target->Truncate(extent);
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+
+        if(!IsAt(tokens, next, TokenType::RIGHT_BRACKET)) {
+            Expect(next, TokenType::RIGHT_BRACKET);
+            Target->Truncate(extent);
+            return make_tuple(NodeRef<Argument>{}, cpos);
+        }
+        next++;
+
+        return make_tuple(Target->Add(Argument{PointerArgument{sub_arg}}), next);
     }
 
-    Parser::ParseReturn<IntegerArgument::sptr> Parser::ParseIntegerArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<IntegerArgument::sptr>();
+    Parser::ParseReturn<NodeRef<Argument>> Parser::ParseArgument(TokenList const & tokens, std::size_t cpos) {
+        if(auto[arg, next] = ParsePointerArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        if(auto[arg, next] = ParseXIndexArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        if(auto[arg, next] = ParseYIndexArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        if(auto[arg, next] = ParseRegisterArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        if(auto[arg, next] = ParseImmediateArgument(tokens, cpos); arg) {
+            return make_tuple(arg, next);
+        }
+        return make_tuple(NodeRef<Argument>{}, cpos);
     }
 
-    Parser::ParseReturn<ImmediateArgument::sptr> Parser::ParseImmediateArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<ImmediateArgument::sptr>();
+    Parser::ParseReturn<NodeRef<Instruction>> Parser::ParseNoArgumentInstruction(std::size_t cpos) {
+        return make_tuple(Target->Add(Instruction{ Opcode{}, {}, 0, {} }), cpos);
     }
 
-    Parser::ParseReturn<RegisterArgument::sptr> Parser::ParseRegisterArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<RegisterArgument::sptr>();
+    Parser::ParseReturn<std::string_view> Parser::ParseWordSize(TokenList const & tokens, std::size_t cpos) {
+        if(IsAt(tokens, cpos, TokenType::WORD_SIZE)) {
+            auto word_size = tokens.Text(cpos);
+            cpos++;
+            return make_tuple(word_size, cpos);
+        } else {
+            Expect(cpos, TokenType::WORD_SIZE);
+            return make_tuple(string_view{}, cpos);
+        }
     }
 
-    Parser::ParseReturn<YIndexArgument::sptr> Parser::ParseYIndexArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<YIndexArgument::sptr>();
+    Parser::ParseReturn<std::optional<Opcode>> Parser::ParseMnemonic(TokenList const & tokens, std::size_t cpos) {
+        if(IsAt(tokens, cpos, TokenType::MNEMONIC)) {
+            auto mnemonic = tokens.GetOpcode(cpos);
+            cpos++;
+            return make_tuple(optional<Opcode>{mnemonic}, cpos);
+        } else {
+            Expect(cpos, TokenType::MNEMONIC);
+            return make_tuple(optional<Opcode>{}, cpos);
+        }
     }
 
-    Parser::ParseReturn<XIndexArgument::sptr> Parser::ParseXIndexArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<XIndexArgument::sptr>();
+    namespace {
+
+        void AppendArgument(string& out, Program const& program, NodeRef<Argument> arg) {
+            visit(Overloaded{
+                [&](RegisterArgument const& reg) {
+                    out += "$";
+                    out += reg.Value;
+                },
+                [&](IntegerArgument const& integer) {
+                    out += to_string(integer.Value);
+                },
+                [&](IdentifierArgument const& ident) {
+                    out += ident.Value;
+                },
+                [&](PointerArgument const& ptr) {
+                    out += "[";
+                    AppendArgument(out, program, ptr.SubArgument);
+                    out += "]";
+                },
+                [&](XIndexArgument const& x) {
+                    out += x.Plus ? "X+" : "X-";
+                    AppendArgument(out, program, x.SubArgument);
+                },
+                [&](YIndexArgument const& y) {
+                    out += y.Plus ? "Y+" : "Y-";
+                    AppendArgument(out, program, y.SubArgument);
+                },
+            }, program[arg]);
+        }
+
     }
 
-    Parser::ParseReturn<PointerArgument::sptr> Parser::PointerArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<PointerArgument::sptr>();
+    std::string ToString(Program const& program) {
+        string ret = "";
+
+        for(auto const& line : program.Lines) {
+            if(line.Label) {
+                ret += program[line.Label].Value;
+                ret += ": ";
+            }
+
+            if(line.Instruction) {
+                auto const& inst = program[line.Instruction];
+                ret += GetOpcodeInfo(inst.Mnemonic).Name;
+                if(!inst.WordSize.empty()) {
+                    ret += " ";
+                    ret += inst.WordSize;
+                }
+                for(size_t arg = 0; arg < inst.ArgumentCount; arg++) {
+                    ret += (arg == 0) ? " " : ", ";
+                    AppendArgument(ret, program, inst.Arguments[arg]);
+                }
+            }
+
+            if(line.Comment) {
+                ret += (line.Label || line.Instruction) ? " ;" : ";";
+                ret += program[line.Comment].Value;
+            }
+
+            ret += "\n";
+        }
+
+        return ret;
     }
 
-    Parser::ParseReturn<Argument::sptr> Parser::ParseArgument(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<Argument::sptr>();
+    namespace {
+
+        /// How a token type reads in a message, the literals all read as `number`
+        string_view Describe(TokenType type) {
+            switch(type) {
+            case TokenType::NEWLINE: return "end of line";
+            case TokenType::COLON: return "':'";
+            case TokenType::SEMICOLON: return "';'";
+            case TokenType::MNEMONIC: return "mnemonic";
+            case TokenType::WORD_SIZE: return "word size";
+            case TokenType::COMMA: return "','";
+            case TokenType::REGISTER: return "register";
+            case TokenType::LEFT_BRACKET: return "'['";
+            case TokenType::RIGHT_BRACKET: return "']'";
+            case TokenType::XPLUS: return "'X+'";
+            case TokenType::XMINUS: return "'X-'";
+            case TokenType::YPLUS: return "'Y+'";
+            case TokenType::YMINUS: return "'Y-'";
+            case TokenType::IDENTIFIER: return "identifier";
+            case TokenType::LABEL: return "label";
+            case TokenType::COMMENT: return "comment";
+            case TokenType::BINARY_LITERAL:
+            case TokenType::OCTAL_LITERAL:
+            case TokenType::DECIMAL_LITERAL:
+            case TokenType::HEX_LITERAL:
+            case TokenType::CHAR_LITERAL:
+                return "number";
+            default: return "token";
+            }
+        }
+
     }
 
-    Parser::ParseReturn<NoArgumentInstruction::sptr> Parser::ParseNoArgumentInstruction(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<NoArgumentInstruction::sptr>();
+    std::string ToString(Diagnostic const& diagnostic, std::string_view file_name) {
+        string ret = string(file_name) + ":" + to_string(diagnostic.Line + 1) + ":" +
+            to_string(diagnostic.Column + 1) + ": error: ";
+
+        switch(diagnostic.Code) {
+        case DiagnosticCode::UnexpectedToken: {
+            vector<string_view> expected;
+            for(unsigned type = 0; type < 64; type++) {
+                auto name = Describe(static_cast<TokenType>(type));
+                if(diagnostic.Expects(static_cast<TokenType>(type)) &&
+                    find(expected.begin(), expected.end(), name) == expected.end()) {
+                    expected.push_back(name);
+                }
+            }
+
+            ret += "expected ";
+            for(size_t idx = 0; idx < expected.size(); idx++) {
+                if(idx != 0) {
+                    ret += (idx + 1 == expected.size()) ? " or " : ", ";
+                }
+                ret += expected[idx];
+            }
+            ret += ", found ";
+            ret += diagnostic.Found ? Describe(*diagnostic.Found) : "end of file";
+            break;
+        }
+        case DiagnosticCode::WordSizeNotAllowed:
+            ret += string(GetOpcodeInfo(diagnostic.Mnemonic).Name) + " doesn't take a word size";
+            break;
+        case DiagnosticCode::NestedPointer:
+            ret += "pointers can't be nested";
+            break;
+        }
+
+        return ret;
     }
 
-    Parser::ParseReturn<WordSize::sptr> Parser::ParseWordSize(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<WordSize::sptr>();
+    ParseResult::ParseResult(Program::sptr program, std::vector<Diagnostic> errors, std::string file_name) :
+        Result{program}, Diagnostics{move(errors)}, File{move(file_name)} { }
+
+    Program::sptr const& ParseResult::Value() const {
+        if(!HasValue()) {
+            throw std::exception(("PARSER: " + FormatErrors()).c_str());
+        }
+        return Result;
     }
 
-    Parser::ParseReturn<Mnemonic::sptr> Parser::ParseMnemonic(TokenList const & tokens, TokenList::const_iterator cpos) {
-        return Parser::ParseReturn<Mnemonic::sptr>();
+    std::string ParseResult::FormatErrors() const {
+        string ret = "";
+
+        for(auto const& diagnostic : Diagnostics) {
+            ret += ToString(diagnostic, File);
+            ret += "\n";
+        }
+
+        return ret;
     }
 
-    
 }
@@ -0,0 +1,218 @@
+#include "stdafx.h"
+#include "Simd.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NPASM_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets any function use any intrinsic, GCC and Clang need to be told per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define NPASM_TARGET(isa)
+#else
+#define NPASM_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace npasm::lexer::simd {
+
+    using namespace std;
+
+    namespace {
+
+        /// Matches the lexer's CC_BLANK class: ' ' and '\a' through '\r' except '\n'
+        inline bool IsBlank(char c) {
+            auto u = static_cast<unsigned char>(c);
+            return u == ' ' || (u >= '\a' && u <= '\r' && u != '\n');
+        }
+
+        std::size_t SkipBlanksScalar(char const* data, std::size_t idx, std::size_t len) {
+            while(idx < len && IsBlank(data[idx])) {
+                idx++;
+            }
+            return idx;
+        }
+
+        std::size_t FindNewlineScalar(char const* data, std::size_t idx, std::size_t len) {
+            while(idx < len && data[idx] != '\n') {
+                idx++;
+            }
+            return idx;
+        }
+
+#ifdef NPASM_SIMD_X86
+
+        inline unsigned CountTrailingZeros(std::uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long idx;
+            _BitScanForward(&idx, mask);
+            return idx;
+#else
+            return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+        }
+
+        // Blank bytes are found as `c == ' ' || (c - '\a' <= 6 && c != '\n')`, the
+        // unsigned range check being `min(c - '\a', 6) == c - '\a'`
+
+        NPASM_TARGET("sse2")
+        std::size_t SkipBlanksSSE2(char const* data, std::size_t idx, std::size_t len) {
+            __m128i const space = _mm_set1_epi8(' ');
+            __m128i const newline = _mm_set1_epi8('\n');
+            __m128i const low = _mm_set1_epi8('\a');
+            __m128i const span = _mm_set1_epi8('\r' - '\a');
+
+            for(; idx + 16 <= len; idx += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + idx));
+                __m128i off = _mm_sub_epi8(v, low);
+                __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(off, span), off);
+                __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_andnot_si128(_mm_cmpeq_epi8(v, newline), control));
+                auto other = ~static_cast<std::uint32_t>(_mm_movemask_epi8(blank)) & 0xffffu;
+                if(other != 0) {
+                    return idx + CountTrailingZeros(other);
+                }
+            }
+            return SkipBlanksScalar(data, idx, len);
+        }
+
+        NPASM_TARGET("sse2")
+        std::size_t FindNewlineSSE2(char const* data, std::size_t idx, std::size_t len) {
+            __m128i const newline = _mm_set1_epi8('\n');
+
+            for(; idx + 16 <= len; idx += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + idx));
+                auto found = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+                if(found != 0) {
+                    return idx + CountTrailingZeros(found);
+                }
+            }
+            return FindNewlineScalar(data, idx, len);
+        }
+
+        NPASM_TARGET("avx2")
+        std::size_t SkipBlanksAVX2(char const* data, std::size_t idx, std::size_t len) {
+            __m256i const space = _mm256_set1_epi8(' ');
+            __m256i const newline = _mm256_set1_epi8('\n');
+            __m256i const low = _mm256_set1_epi8('\a');
+            __m256i const span = _mm256_set1_epi8('\r' - '\a');
+
+            for(; idx + 32 <= len; idx += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + idx));
+                __m256i off = _mm256_sub_epi8(v, low);
+                __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(off, span), off);
+                __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_andnot_si256(_mm256_cmpeq_epi8(v, newline), control));
+                auto other = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(blank));
+                if(other != 0) {
+                    return idx + CountTrailingZeros(other);
+                }
+            }
+            return SkipBlanksSSE2(data, idx, len);
+        }
+
+        NPASM_TARGET("avx2")
+        std::size_t FindNewlineAVX2(char const* data, std::size_t idx, std::size_t len) {
+            __m256i const newline = _mm256_set1_epi8('\n');
+
+            for(; idx + 32 <= len; idx += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + idx));
+                auto found = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+                if(found != 0) {
+                    return idx + CountTrailingZeros(found);
+                }
+            }
+            return FindNewlineSSE2(data, idx, len);
+        }
+
+        SimdLevel Detect() {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 0);
+            int max_leaf = info[0];
+
+            __cpuid(info, 1);
+            bool sse2 = (info[3] & (1 << 26)) != 0;
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            bool avx2 = false;
+
+            // AVX2 also needs the OS to save the YMM registers on a context switch
+            if(max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+                __cpuidex(info, 7, 0);
+                avx2 = (info[1] & (1 << 5)) != 0;
+            }
+
+            return avx2 ? SimdLevel::AVX2 : sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("avx2")) {
+                return SimdLevel::AVX2;
+            }
+            if(__builtin_cpu_supports("sse2")) {
+                return SimdLevel::SSE2;
+            }
+            return SimdLevel::Scalar;
+#endif
+        }
+
+#else
+
+        SimdLevel Detect() {
+            return SimdLevel::Scalar;
+        }
+
+#endif
+
+        using Kernel = std::size_t (*)(char const*, std::size_t, std::size_t);
+
+        /// The kernels for one SimdLevel
+        struct Kernels {
+            Kernel SkipBlanks;
+            Kernel FindNewline;
+        };
+
+        Kernels ForLevel(SimdLevel level) {
+#ifdef NPASM_SIMD_X86
+            switch(level) {
+            case SimdLevel::AVX2:
+                return { SkipBlanksAVX2, FindNewlineAVX2 };
+            case SimdLevel::SSE2:
+                return { SkipBlanksSSE2, FindNewlineSSE2 };
+            default:
+                break;
+            }
+#endif
+            return { SkipBlanksScalar, FindNewlineScalar };
+        }
+
+        /// The kernels picked for this CPU, chosen on first use
+        Kernels const& Active() {
+            static Kernels const kernels = ForLevel(DetectedLevel());
+            return kernels;
+        }
+
+    }
+
+    SimdLevel DetectedLevel() {
+        static SimdLevel const level = Detect();
+        return level;
+    }
+
+    std::size_t SkipBlanks(std::string_view str, std::size_t idx) {
+        return Active().SkipBlanks(str.data(), idx, str.length());
+    }
+
+    std::size_t FindNewline(std::string_view str, std::size_t idx) {
+        return Active().FindNewline(str.data(), idx, str.length());
+    }
+
+    std::size_t SkipBlanks(std::string_view str, std::size_t idx, SimdLevel level) {
+        return ForLevel(level).SkipBlanks(str.data(), idx, str.length());
+    }
+
+    std::size_t FindNewline(std::string_view str, std::size_t idx, SimdLevel level) {
+        return ForLevel(level).FindNewline(str.data(), idx, str.length());
+    }
+
+}
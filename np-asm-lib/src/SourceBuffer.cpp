@@ -0,0 +1,187 @@
+#include "stdafx.h"
+#include "Simd.hpp"
+#include "SourceBuffer.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace npasm::lexer {
+
+    using namespace std;
+
+    SourceBuffer::SourceBuffer() : Owned{}, Mapping{nullptr}, MappingSize{0}, View{}, LineIndexOnce{}, LineStarts{} { }
+
+    SourceBuffer::~SourceBuffer() {
+        if(Mapping != nullptr) {
+#ifdef _WIN32
+            UnmapViewOfFile(Mapping);
+#else
+            munmap(Mapping, MappingSize);
+#endif
+        }
+    }
+
+    SourceBuffer::sptr SourceBuffer::FromString(std::string_view text) {
+        auto buffer = shared_ptr<SourceBuffer>(new SourceBuffer());
+        buffer->Owned = string(text);
+        buffer->View = buffer->Owned;
+        return buffer;
+    }
+
+    SourceBuffer::sptr SourceBuffer::Adopt(std::string&& text) {
+        auto buffer = shared_ptr<SourceBuffer>(new SourceBuffer());
+        buffer->Owned = std::move(text);
+        buffer->View = buffer->Owned;
+        return buffer;
+    }
+
+    std::uint32_t SourceBuffer::LineOf(std::size_t offset) const {
+        auto const& starts = LineIndex();
+        return static_cast<std::uint32_t>(upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1);
+    }
+
+    std::size_t SourceBuffer::LineStart(std::uint32_t line) const {
+        return LineIndex()[line];
+    }
+
+    std::size_t SourceBuffer::LineCount() const {
+        return LineIndex().size();
+    }
+
+    std::vector<std::uint32_t> const& SourceBuffer::LineIndex() const {
+        call_once(LineIndexOnce, [this]() {
+            if(View.length() > numeric_limits<std::uint32_t>::max()) {
+                throw std::exception("Source file is too large");
+            }
+            LineStarts.push_back(0);
+            for(size_t nl = simd::FindNewline(View, 0); nl < View.length(); nl = simd::FindNewline(View, nl + 1)) {
+                LineStarts.push_back(static_cast<std::uint32_t>(nl + 1));
+            }
+        });
+        return LineStarts;
+    }
+
+    std::uint64_t HashText(std::string_view text) {
+        constexpr std::uint64_t Multiplier = 0xBF58476D1CE4E5B9;
+        auto mix = [](std::uint64_t hash, std::uint64_t word) {
+            hash = (hash ^ word) * Multiplier;
+            return hash ^ (hash >> 31);
+        };
+
+        // Eight bytes at a time, the tail padded with zeros
+        std::uint64_t hash = 0x9E3779B97F4A7C15 ^ text.length();
+        size_t idx = 0;
+        for(; idx + 8 <= text.length(); idx += 8) {
+            std::uint64_t word;
+            memcpy(&word, text.data() + idx, 8);
+            hash = mix(hash, word);
+        }
+        std::uint64_t tail = 0;
+        if(idx < text.length()) {
+            memcpy(&tail, text.data() + idx, text.length() - idx);
+        }
+        hash = mix(hash, tail);
+
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCD;
+        return hash ^ (hash >> 33);
+    }
+
+#ifdef _WIN32
+
+    SourceBuffer::sptr SourceBuffer::FromFile(std::string const& path) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE) {
+            throw std::exception("Unable to open source file");
+        }
+
+        auto buffer = shared_ptr<SourceBuffer>(new SourceBuffer());
+        LARGE_INTEGER size;
+
+        if(GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(mapping != nullptr) {
+                buffer->Mapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping); // The view keeps the mapping alive
+            }
+            if(buffer->Mapping != nullptr) {
+                buffer->MappingSize = static_cast<size_t>(size.QuadPart);
+                buffer->View = string_view(static_cast<char const*>(buffer->Mapping), buffer->MappingSize);
+                CloseHandle(file);
+                return buffer;
+            }
+        }
+
+        // Not mappable, read it instead
+        char chunk[64 * 1024];
+        for(DWORD read = 0;;) {
+            if(!ReadFile(file, chunk, sizeof(chunk), &read, nullptr)) {
+                CloseHandle(file);
+                throw std::exception("Unable to read source file");
+            }
+            if(read == 0) {
+                break;
+            }
+            buffer->Owned.append(chunk, read);
+        }
+        CloseHandle(file);
+        buffer->View = buffer->Owned;
+        return buffer;
+    }
+
+#else
+
+    SourceBuffer::sptr SourceBuffer::FromFile(std::string const& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) {
+            throw std::exception("Unable to open source file");
+        }
+
+        auto buffer = shared_ptr<SourceBuffer>(new SourceBuffer());
+        struct stat info;
+
+        if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping != MAP_FAILED) {
+                madvise(mapping, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+                buffer->Mapping = mapping;
+                buffer->MappingSize = static_cast<size_t>(info.st_size);
+                buffer->View = string_view(static_cast<char const*>(mapping), buffer->MappingSize);
+                close(fd);
+                return buffer;
+            }
+        }
+
+        // Not mappable, read it instead
+        char chunk[64 * 1024];
+        for(;;) {
+            auto got = read(fd, chunk, sizeof(chunk));
+            if(got < 0 && errno == EINTR) { // Interrupted before anything was read, try again
+                continue;
+            }
+            if(got < 0) {
+                close(fd);
+                throw std::exception("Unable to read source file");
+            }
+            if(got == 0) {
+                break;
+            }
+            buffer->Owned.append(chunk, static_cast<size_t>(got));
+        }
+        close(fd);
+        buffer->View = buffer->Owned;
+        return buffer;
+    }
+
+#endif
+
+}
@@ -0,0 +1,89 @@
+#include "stdafx.h"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+
+namespace npasm::lexer {
+
+    using namespace std;
+
+    SourceManager::SourceManager() : Files{}, NextBase{1} { }
+
+    SourceManager::~SourceManager() { }
+
+    FileId SourceManager::AddFile(std::string const& path) {
+        return AddBuffer(path, SourceBuffer::FromFile(path));
+    }
+
+    FileId SourceManager::AddBuffer(std::string const& name, SourceBuffer::sptr buffer) {
+        // One extra location per file so its end can be pointed at too
+        auto end = NextBase + buffer->Text().length() + 1;
+        if(end > numeric_limits<std::uint32_t>::max() || Files.size() >= InvalidFile) {
+            throw std::exception("Too much source code for 32-bit source locations");
+        }
+
+        Files.push_back({ name, buffer, static_cast<std::uint32_t>(NextBase) });
+        NextBase = end;
+        return static_cast<FileId>(Files.size() - 1);
+    }
+
+    std::string const& SourceManager::FileName(FileId file) const {
+        return Files.at(file).Name;
+    }
+
+    SourceBuffer::sptr const& SourceManager::Buffer(FileId file) const {
+        return Files.at(file).Buffer;
+    }
+
+    SourceLocation SourceManager::Location(FileId file, std::uint32_t offset) const {
+        auto const& entry = Files.at(file);
+        if(offset > entry.Buffer->Text().length()) {
+            throw std::exception("Offset is outside the source file");
+        }
+        return SourceLocation::FromRaw(entry.Base + offset);
+    }
+
+    FileId SourceManager::FileOf(SourceLocation loc) const {
+        if(!loc.IsValid() || loc.GetRaw() >= NextBase) {
+            return InvalidFile;
+        }
+        auto after = upper_bound(Files.begin(), Files.end(), loc.GetRaw(), [](std::uint32_t raw, Entry const& entry) {
+            return raw < entry.Base;
+        });
+        return static_cast<FileId>(after - Files.begin() - 1);
+    }
+
+    std::uint32_t SourceManager::OffsetOf(SourceLocation loc) const {
+        auto file = FileOf(loc);
+        return (file != InvalidFile) ? loc.GetRaw() - Files[file].Base : 0;
+    }
+
+    std::uint32_t SourceManager::Line(SourceLocation loc) const {
+        auto file = FileOf(loc);
+        return (file != InvalidFile) ? Files[file].Buffer->LineOf(loc.GetRaw() - Files[file].Base) : 0;
+    }
+
+    std::uint32_t SourceManager::Column(SourceLocation loc) const {
+        return Resolve(loc).Column;
+    }
+
+    SourceManager::LineColumn SourceManager::Resolve(SourceLocation loc) const {
+        auto file = FileOf(loc);
+        if(file == InvalidFile) {
+            return { "", 0, 0 };
+        }
+
+        auto const& entry = Files[file];
+        auto offset = loc.GetRaw() - entry.Base;
+        auto line = entry.Buffer->LineOf(offset);
+        return { entry.Name, line, static_cast<std::uint32_t>(offset - entry.Buffer->LineStart(line)) };
+    }
+
+    std::string SourceManager::ToString(SourceLocation loc) const {
+        if(FileOf(loc) == InvalidFile) {
+            return "<unknown>";
+        }
+        auto resolved = Resolve(loc);
+        return string(resolved.FileName) + ":" + to_string(resolved.Line + 1) + ":" + to_string(resolved.Column + 1);
+    }
+
+}
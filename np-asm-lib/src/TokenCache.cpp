@@ -0,0 +1,217 @@
+#include "stdafx.h"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+#include "Tokens.hpp"
+#include "TokenStream.hpp"
+#include "Lexer.hpp"
+#include "TokenCache.hpp"
+
+namespace npasm::lexer {
+
+    using namespace std;
+
+    namespace {
+
+        constexpr char Magic[4] = { 'N', 'P', 'T', 'K' };
+
+        /// Starts every entry, followed by the arrays in order of decreasing alignment:
+        /// Values, Offsets, Lengths, Payloads, Texts, Types
+        struct Header {
+            char Magic[4];
+            std::uint32_t Version;
+            std::uint64_t SourceLength;
+            std::uint64_t SourceHash;
+            std::uint64_t TokenCount;
+            std::uint64_t ValueCount;
+            std::uint64_t TextCount;
+            /// HashText of everything after the header
+            std::uint64_t ArraysHash;
+        };
+        static_assert(sizeof(Header) % alignof(std::int64_t) == 0, "The arrays must stay aligned");
+
+        std::uint64_t EntrySize(Header const& header) {
+            return sizeof(Header) +
+                header.ValueCount * sizeof(std::int64_t) +
+                header.TokenCount * 3 * sizeof(std::uint32_t) +
+                header.TextCount * sizeof(TokenStream::Span) +
+                header.TokenCount * sizeof(TokenType);
+        }
+
+        /// Copies `count` elements from `data` at `at` into `into` and moves `at` past them
+        template<typename T>
+        void ReadArray(string_view data, size_t& at, vector<T>& into) {
+            if(!into.empty()) {
+                memcpy(into.data(), data.data() + at, into.size() * sizeof(T));
+            }
+            at += into.size() * sizeof(T);
+        }
+
+        template<typename T>
+        void WriteArray(string& out, vector<T> const& from) {
+            out.append(reinterpret_cast<char const*>(from.data()), from.size() * sizeof(T));
+        }
+
+        bool InSource(std::uint64_t offset, std::uint64_t length, string_view text) {
+            return offset <= text.length() && length <= text.length() - offset;
+        }
+
+    }
+
+    TokenCache::TokenCache(std::string const& directory) : Directory{directory}, HitCount{0}, MissCount{0} {
+        filesystem::create_directories(Directory);
+    }
+
+    TokenCache::~TokenCache() { }
+
+    TokenStream TokenCache::Lex(Lexer& lexer, SourceManager const& sources, FileId file) {
+        auto text = sources.Buffer(file)->Text();
+        auto hash = HashText(text);
+        auto path = PathFor(text);
+
+        auto tokens = lexer.BeginLines(sources, file);
+        if(Load(path, text, hash, tokens)) {
+            HitCount++;
+            return tokens;
+        }
+
+        MissCount++;
+        tokens = lexer.Lex(sources, file);
+        Store(path, hash, tokens);
+        return tokens;
+    }
+
+    std::string TokenCache::PathFor(std::string_view text) const {
+        ostringstream name;
+        name << hex << setw(16) << setfill('0') << HashText(text) << "-" << dec << text.length() << ".npt";
+        return (filesystem::path(Directory) / name.str()).string();
+    }
+
+    bool TokenCache::Load(std::string const& path, std::string_view text, std::uint64_t hash, TokenStream& tokens) const {
+        error_code error;
+        if(!filesystem::is_regular_file(path, error)) {
+            return false;
+        }
+
+        SourceBuffer::sptr entry;
+        try {
+            entry = SourceBuffer::FromFile(path);
+        } catch(std::exception const&) {
+            return false;
+        }
+        auto data = entry->Text();
+
+        Header header;
+        if(data.length() < sizeof(Header)) {
+            return false;
+        }
+        memcpy(&header, data.data(), sizeof(Header));
+
+        // Every token takes at least a byte, so the counts can't overflow the size
+        if(memcmp(header.Magic, Magic, sizeof(Magic)) != 0 ||
+            header.Version != FormatVersion ||
+            header.SourceLength != text.length() ||
+            header.SourceHash != hash ||
+            header.TokenCount > text.length() ||
+            header.ValueCount > header.TokenCount ||
+            header.TextCount > header.TokenCount ||
+            EntrySize(header) != data.length() ||
+            HashText(data.substr(sizeof(Header))) != header.ArraysHash) {
+            return false;
+        }
+
+        tokens.Resize(header.TokenCount, header.ValueCount, header.TextCount);
+        size_t at = sizeof(Header);
+        ReadArray(data, at, tokens.Values);
+        ReadArray(data, at, tokens.Offsets);
+        ReadArray(data, at, tokens.Lengths);
+        ReadArray(data, at, tokens.Payloads);
+        ReadArray(data, at, tokens.Texts);
+        ReadArray(data, at, tokens.Types);
+
+        // The hash only catches accidents, the tokens are used as they are and must stay within the source
+        for(auto const& span : tokens.Texts) {
+            if(!InSource(span.Offset, span.Length, text)) {
+                return false;
+            }
+        }
+        for(size_t idx = 0; idx < header.TokenCount; idx++) {
+            if(!InSource(tokens.Offsets[idx], tokens.Lengths[idx], text)) {
+                return false;
+            }
+            auto payload = tokens.Payloads[idx];
+            switch(tokens.Types[idx]) {
+            case TokenType::MNEMONIC:
+                if(payload >= OpcodeCount) {
+                    return false;
+                }
+                break;
+            case TokenType::BINARY_LITERAL:
+            case TokenType::OCTAL_LITERAL:
+            case TokenType::DECIMAL_LITERAL:
+            case TokenType::HEX_LITERAL:
+                if(payload >= header.ValueCount) {
+                    return false;
+                }
+                break;
+            case TokenType::IDENTIFIER:
+            case TokenType::LABEL:
+            case TokenType::REGISTER:
+            case TokenType::WORD_SIZE:
+            case TokenType::COMMENT:
+                if(payload >= header.TextCount) {
+                    return false;
+                }
+                break;
+            default:
+                if(static_cast<unsigned>(tokens.Types[idx]) > static_cast<unsigned>(TokenType::DIRECTIVE)) {
+                    return false;
+                }
+                break;
+            }
+        }
+        return true;
+    }
+
+    void TokenCache::Store(std::string const& path, std::uint64_t hash, TokenStream const& tokens) const {
+        auto header = Header{};
+        memcpy(header.Magic, Magic, sizeof(Magic));
+        header.Version = FormatVersion;
+        header.SourceLength = tokens.Source().length();
+        header.SourceHash = hash;
+        header.TokenCount = tokens.size();
+        header.ValueCount = tokens.Values.size();
+        header.TextCount = tokens.Texts.size();
+
+        string entry(sizeof(Header), '\0');
+        entry.reserve(EntrySize(header));
+        WriteArray(entry, tokens.Values);
+        WriteArray(entry, tokens.Offsets);
+        WriteArray(entry, tokens.Lengths);
+        WriteArray(entry, tokens.Payloads);
+        WriteArray(entry, tokens.Texts);
+        WriteArray(entry, tokens.Types);
+        header.ArraysHash = HashText(string_view(entry).substr(sizeof(Header)));
+        memcpy(entry.data(), &header, sizeof(Header));
+
+        // Readers only ever see a complete entry, or none
+        auto temp = path + "." + to_string(random_device{}()) + ".tmp";
+        {
+            ofstream out(temp, ios::binary);
+            out.write(entry.data(), static_cast<streamsize>(entry.size()));
+            if(!out) {
+                out.close();
+                error_code error;
+                filesystem::remove(temp, error);
+                return;
+            }
+        }
+
+        error_code error;
+        filesystem::rename(temp, path, error);
+        if(error) {
+            filesystem::remove(temp, error);
+        }
+    }
+
+}
@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+#include "Tokens.hpp"
+#include "TokenStream.hpp"
+#include "Lexer.hpp"
+#include "TokenReader.hpp"
+
+namespace npasm::lexer {
+
+    using namespace std;
+
+    TokenReader::TokenReader(std::istream& input, std::string const& file_name, std::size_t chunk_size) :
+        Input{input}, ChunkSize{max<size_t>(chunk_size, 1)}, Lex{}, Pending{}, AtEnd{false},
+        Window{file_name, SourceBuffer::FromString("")}, WindowOffset{0}, WindowLine{0}, Pos{0} {
+        Lex.FileName = file_name;
+    }
+
+    TokenReader::~TokenReader() { }
+
+    bool TokenReader::Next() {
+        if(Pos + 1 < Window.size()) {
+            Pos++;
+            return true;
+        }
+
+        while(Refill()) {
+            if(!Window.empty()) {
+                Pos = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool TokenReader::Refill() {
+        if(AtEnd && Pending.empty()) {
+            return false;
+        }
+
+        size_t cut = string::npos;
+        while(!AtEnd) {
+            size_t old = Pending.size();
+            Pending.resize(old + ChunkSize);
+            Input.read(&Pending[old], static_cast<streamsize>(ChunkSize));
+            Pending.resize(old + static_cast<size_t>(Input.gcount()));
+
+            if(Pending.size() == old) {
+                AtEnd = true;
+                break;
+            }
+
+            // Only the new bytes can hold a newline, the carried over part had none
+            auto nl = string_view(Pending).substr(old).rfind('\n');
+            if(nl != string_view::npos) {
+                cut = old + nl + 1;
+                break;
+            }
+        }
+
+        if(AtEnd) {
+            cut = Pending.size(); // The last line may lack a newline
+        }
+
+        auto rest = Pending.substr(cut);
+        Pending.resize(cut);
+
+        auto done = Window.Source();
+        WindowOffset += done.length();
+        WindowLine += static_cast<std::uint32_t>(count(done.begin(), done.end(), '\n'));
+
+        Window = TokenStream(Window.FileName(), SourceBuffer::Adopt(std::move(Pending)), WindowLine);
+        Lex.FirstLine = WindowLine;
+        Lex.LexStringIntern(Window.Source(), Window);
+
+        Pending = std::move(rest);
+        return true;
+    }
+
+}
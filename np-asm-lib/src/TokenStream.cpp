@@ -0,0 +1,576 @@
+#include "stdafx.h"
+#include "Simd.hpp"
+#include "Opcodes.hpp"
+#include "SourceBuffer.hpp"
+#include "SourceManager.hpp"
+#include "Tokens.hpp"
+#include "TokenStream.hpp"
+
+namespace npasm::lexer {
+
+    using namespace std;
+
+    namespace {
+
+        /// Which side array a token's payload indexes into
+        enum class PayloadKind {
+            None,
+            Value,
+            Text,
+        };
+
+        PayloadKind KindOf(TokenType type) {
+            switch(type) {
+            case TokenType::BINARY_LITERAL:
+            case TokenType::OCTAL_LITERAL:
+            case TokenType::DECIMAL_LITERAL:
+            case TokenType::HEX_LITERAL:
+                return PayloadKind::Value;
+            case TokenType::IDENTIFIER:
+            case TokenType::LABEL:
+            case TokenType::REGISTER:
+            case TokenType::WORD_SIZE:
+            case TokenType::COMMENT:
+                return PayloadKind::Text;
+            default:
+                return PayloadKind::None;
+            }
+        }
+
+        /// Stores `item` in a free slot of `into`, or a new one, and returns its index
+        template<typename T>
+        std::uint32_t Place(vector<T>& into, vector<std::uint32_t>& free, T const& item) {
+            if(free.empty()) {
+                into.push_back(item);
+                return static_cast<std::uint32_t>(into.size() - 1);
+            }
+            auto slot = free.back();
+            free.pop_back();
+            into[slot] = item;
+            return slot;
+        }
+
+        template<typename T>
+        void Widen(vector<T>& array, size_t at, size_t count) {
+            array.insert(array.begin() + at, count, T{});
+        }
+
+    }
+
+    TokenStream::TokenStream() : TokenStream("", SourceBuffer::FromString("")) { }
+
+    TokenStream::TokenStream(std::string const& file_name, SourceBuffer::sptr source, std::uint32_t first_line, SourceLocation origin) :
+        File{file_name}, SourceText{source}, FirstLine{first_line}, Origin{origin}, Edited{},
+        Gap{0}, GapSize{0}, Shift{0}, Work{0} { }
+
+    TokenStream::~TokenStream() { }
+
+    std::uint32_t TokenStream::Line(std::size_t idx) const {
+        return LineAt(Offset(idx));
+    }
+
+    std::uint32_t TokenStream::LineAt(std::size_t offset) const {
+        if(!Edited) {
+            return FirstLine + SourceText->LineOf(offset);
+        }
+
+        // Count the line starts up to the offset on both sides of the gap
+        auto const& edited = *Edited;
+        auto gap = edited.LineStarts.begin() + edited.LineGap;
+        auto line = static_cast<size_t>(upper_bound(edited.LineStarts.begin(), gap, offset) - edited.LineStarts.begin());
+        if(line == edited.LineGap) {
+            auto after = gap + edited.LineGapSize;
+            line += upper_bound(after, edited.LineStarts.end(), offset, [&](std::size_t off, std::uint32_t start) {
+                return off < static_cast<std::uint32_t>(start + edited.LineShift);
+            }) - after;
+        }
+        return FirstLine + static_cast<std::uint32_t>(line - 1);
+    }
+
+    std::int64_t TokenStream::Value(std::size_t idx) const {
+        switch(Type(idx)) {
+        case TokenType::CHAR_LITERAL:
+            return static_cast<char>(Payloads[At(idx)]);
+        case TokenType::BINARY_LITERAL:
+        case TokenType::OCTAL_LITERAL:
+        case TokenType::DECIMAL_LITERAL:
+        case TokenType::HEX_LITERAL:
+            return Values[Payloads[At(idx)]];
+        default:
+            return 0;
+        }
+    }
+
+    std::string_view TokenStream::Text(std::size_t idx) const {
+        switch(Type(idx)) {
+        case TokenType::IDENTIFIER:
+        case TokenType::LABEL:
+        case TokenType::REGISTER:
+        case TokenType::WORD_SIZE:
+        case TokenType::COMMENT: {
+            auto const& span = Texts[Payloads[At(idx)]];
+            return SourceRange(span.Offset + ShiftOf(idx), span.Length);
+        }
+        default:
+            return SourceRange(Offset(idx), Length(idx));
+        }
+    }
+
+    std::string_view TokenStream::Source() const {
+        return Buffer()->Text();
+    }
+
+    std::size_t TokenStream::SourceLength() const {
+        return Edited ? Edited->Text.length() - Edited->TextGapSize : SourceText->Text().length();
+    }
+
+    SourceBuffer::sptr const& TokenStream::Buffer() const {
+        if(!Edited) {
+            return SourceText;
+        }
+
+        auto const& edited = *Edited;
+        auto& whole = *edited.Whole;
+        call_once(whole.Once, [&]() {
+            string text;
+            text.reserve(edited.Text.length() - edited.TextGapSize);
+            text.append(edited.Text, 0, edited.TextGap).append(edited.Text, edited.TextGap + edited.TextGapSize);
+            whole.Buffer = SourceBuffer::Adopt(std::move(text));
+        });
+        return whole.Buffer;
+    }
+
+    std::pair<std::string_view, std::string_view> TokenStream::SourceHalves() const {
+        if(!Edited) {
+            return { SourceText->Text(), {} };
+        }
+        auto text = string_view(Edited->Text);
+        return { text.substr(0, Edited->TextGap), text.substr(Edited->TextGap + Edited->TextGapSize) };
+    }
+
+    std::string_view TokenStream::SourceRange(std::size_t offset, std::size_t length) const {
+        if(!Edited) {
+            return SourceText->Text().substr(offset, length);
+        }
+        auto text = string_view(Edited->Text);
+        return (offset < Edited->TextGap) ? text.substr(offset, length) : text.substr(offset + Edited->TextGapSize, length);
+    }
+
+    void TokenStream::Append(TokenType type, std::uint32_t offset, std::uint32_t length) {
+        // A new token is the last one, so it is after the gap
+        Types.push_back(type);
+        Offsets.push_back(offset - Shift);
+        Lengths.push_back(length);
+        Payloads.push_back(0);
+    }
+
+    void TokenStream::AppendOpcode(std::uint32_t offset, std::uint32_t length, Opcode op) {
+        Append(TokenType::MNEMONIC, offset, length);
+        Payloads.back() = static_cast<std::uint32_t>(op);
+    }
+
+    void TokenStream::AppendValue(TokenType type, std::uint32_t offset, std::uint32_t length, std::int64_t value) {
+        Append(type, offset, length);
+        if(type == TokenType::CHAR_LITERAL) {
+            Payloads.back() = static_cast<std::uint8_t>(value);
+        } else {
+            Payloads.back() = static_cast<std::uint32_t>(Values.size());
+            Values.push_back(value);
+        }
+    }
+
+    void TokenStream::AppendText(TokenType type, std::uint32_t offset, std::uint32_t length, Span text) {
+        Append(type, offset, length);
+        Payloads.back() = static_cast<std::uint32_t>(Texts.size());
+        Texts.push_back({ text.Offset - Shift, text.Length });
+    }
+
+    void TokenStream::Reserve(std::size_t count) {
+        Types.reserve(count);
+        Offsets.reserve(count);
+        Lengths.reserve(count);
+        Payloads.reserve(count);
+    }
+
+    void TokenStream::Clear() {
+        Types.clear();
+        Offsets.clear();
+        Lengths.clear();
+        Payloads.clear();
+        Values.clear();
+        Texts.clear();
+        FreeValues.clear();
+        FreeTexts.clear();
+        Gap = GapSize = 0;
+        Shift = 0;
+    }
+
+    void TokenStream::Resize(std::size_t count, std::size_t values, std::size_t texts) {
+        Clear();
+        Types.resize(count);
+        Offsets.resize(count);
+        Lengths.resize(count);
+        Payloads.resize(count);
+        Values.resize(values);
+        Texts.resize(texts);
+    }
+
+    void TokenStream::CopyPart(TokenStream const& part, std::size_t at, std::size_t value_at, std::size_t text_at) {
+        copy(part.Types.begin(), part.Types.end(), Types.begin() + at);
+        copy(part.Offsets.begin(), part.Offsets.end(), Offsets.begin() + at);
+        copy(part.Lengths.begin(), part.Lengths.end(), Lengths.begin() + at);
+        copy(part.Values.begin(), part.Values.end(), Values.begin() + value_at);
+        copy(part.Texts.begin(), part.Texts.end(), Texts.begin() + text_at);
+
+        for(size_t idx = 0; idx < part.size(); idx++) {
+            // Payloads that index into the values or texts move with them
+            auto payload = part.Payloads[idx];
+            switch(KindOf(part.Types[idx])) {
+            case PayloadKind::Value:
+                payload += static_cast<std::uint32_t>(value_at);
+                break;
+            case PayloadKind::Text:
+                payload += static_cast<std::uint32_t>(text_at);
+                break;
+            default:
+                break;
+            }
+            Payloads[at + idx] = payload;
+        }
+    }
+
+    void TokenStream::CheckEdit(std::size_t offset, std::size_t length, std::string_view replacement) const {
+        auto old_length = SourceLength();
+        if(offset > old_length || length > old_length - offset) {
+            throw std::exception("Edit is outside the source");
+        }
+        if(old_length - length + replacement.length() > numeric_limits<std::uint32_t>::max()) {
+            throw std::exception("Source file is too large");
+        }
+    }
+
+    TokenStream::EditedLines TokenStream::LinesOf(std::size_t offset, std::size_t length, std::string_view replacement) const {
+        CheckEdit(offset, length, replacement);
+        auto [head, tail] = SourceHalves();
+
+        size_t begin = 0;
+        if(offset > 0) {
+            auto nl = string_view::npos;
+            if(offset - 1 >= head.length()) {
+                nl = tail.rfind('\n', offset - 1 - head.length());
+                nl = (nl == string_view::npos) ? nl : head.length() + nl;
+            }
+            if(nl == string_view::npos) {
+                nl = head.rfind('\n', offset - 1);
+            }
+            begin = (nl == string_view::npos) ? 0 : nl + 1;
+        }
+
+        size_t end = offset + length;
+        size_t old_end = 0;
+        if(auto nl = (end < head.length()) ? simd::FindNewline(head, end) : head.length(); nl < head.length()) {
+            old_end = nl + 1;
+        } else {
+            auto from = max(end, head.length()) - head.length();
+            old_end = head.length() + min(simd::FindNewline(tail, from) + 1, tail.length());
+        }
+
+        // Copies [from, to) of the source, which may straddle the gap
+        auto lines = EditedLines{ begin, old_end, LineAt(begin), {} };
+        auto append = [&](size_t from, size_t to) {
+            if(from < head.length()) {
+                lines.Text.append(head.substr(from, min(to, head.length()) - from));
+            }
+            if(to > head.length()) {
+                auto at = max(from, head.length());
+                lines.Text.append(tail.substr(at - head.length(), to - at));
+            }
+        };
+        lines.Text.reserve(old_end - begin - length + replacement.length());
+        append(begin, offset);
+        lines.Text.append(replacement);
+        append(end, old_end);
+        return lines;
+    }
+
+    void TokenStream::EditSource(std::size_t offset, std::size_t length, std::string_view replacement) {
+        CheckEdit(offset, length, replacement);
+
+        if(!Edited) {
+            auto& edited = Edited.emplace();
+            edited.Text = string(SourceText->Text());
+            edited.TextGap = edited.Text.length();
+            edited.TextGapSize = 0;
+            edited.LineStarts.resize(SourceText->LineCount());
+            for(size_t line = 0; line < edited.LineStarts.size(); line++) {
+                edited.LineStarts[line] = static_cast<std::uint32_t>(SourceText->LineStart(static_cast<std::uint32_t>(line)));
+            }
+            edited.LineGap = edited.LineStarts.size();
+            edited.LineGapSize = 0;
+            edited.LineShift = 0;
+            SourceText = nullptr;
+            Origin = {};
+        }
+        auto& edited = *Edited;
+        auto& text = edited.Text;
+
+        auto move_text_gap = [&](size_t to) {
+            if(edited.TextGapSize == 0) {
+                // Nothing to move over
+            } else if(to < edited.TextGap) {
+                memmove(&text[to + edited.TextGapSize], &text[to], edited.TextGap - to);
+                Work += edited.TextGap - to;
+            } else {
+                memmove(&text[edited.TextGap], &text[edited.TextGap + edited.TextGapSize], to - edited.TextGap);
+                Work += to - edited.TextGap;
+            }
+            edited.TextGap = to;
+        };
+
+        // With the gap at the end of the edit, its first line starts before the
+        // gap and its last line ends after it
+        move_text_gap(offset + length);
+        auto before = string_view(text).substr(0, edited.TextGap);
+        auto after = string_view(text).substr(edited.TextGap + edited.TextGapSize);
+
+        size_t begin = 0;
+        if(offset > 0) {
+            auto nl = before.rfind('\n', offset - 1);
+            begin = (nl == string_view::npos) ? 0 : nl + 1;
+        }
+        size_t old_end = edited.TextGap + min(simd::FindNewline(after, 0) + 1, after.length());
+        size_t new_end = old_end - length + replacement.length();
+        Work += old_end - begin;
+
+        // Delete the old bytes into the gap and fill it with the new ones
+        edited.TextGap = offset;
+        edited.TextGapSize += length;
+        if(edited.TextGapSize < replacement.length()) {
+            // An eighth of the text besides, so widening again takes many edits
+            auto extra = replacement.length() - edited.TextGapSize + text.length() / 8 + 64;
+            Work += text.length() - edited.TextGap;
+            text.insert(edited.TextGap, extra, '\0');
+            edited.TextGapSize += extra;
+        }
+        memcpy(&text[edited.TextGap], replacement.data(), replacement.length());
+        edited.TextGap += replacement.length();
+        edited.TextGapSize -= replacement.length();
+        Work += replacement.length();
+
+        // The rest of the last line joins the edited lines in front of the gap
+        move_text_gap(new_end);
+        auto lines = string_view(text).substr(0, new_end);
+
+        // The newlines within the old lines are replaced by those within the new ones
+        auto& starts = edited.LineStarts;
+        auto start_of = [&](size_t line) {
+            return (line < edited.LineGap) ? starts[line] : static_cast<std::uint32_t>(starts[line + edited.LineGapSize] + edited.LineShift);
+        };
+        auto first_after = [&](size_t pos) {
+            size_t lo = 0, hi = starts.size() - edited.LineGapSize;
+            while(lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if(start_of(mid) <= pos) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo;
+        };
+        size_t line_first = first_after(begin);
+        size_t line_last = first_after(old_end);
+
+        if(edited.LineGapSize == 0 && edited.LineShift == 0) {
+            edited.LineGap = line_last;
+        }
+        for(; edited.LineGap > line_last; edited.LineGap--) {
+            starts[edited.LineGap - 1 + edited.LineGapSize] = starts[edited.LineGap - 1] - edited.LineShift;
+            Work++;
+        }
+        for(; edited.LineGap < line_last; edited.LineGap++) {
+            starts[edited.LineGap] = starts[edited.LineGap + edited.LineGapSize] + edited.LineShift;
+            Work++;
+        }
+        edited.LineGapSize += line_last - line_first;
+        edited.LineGap = line_first;
+
+        for(size_t nl = simd::FindNewline(lines, begin); nl < lines.length(); nl = simd::FindNewline(lines, nl + 1)) {
+            if(edited.LineGapSize == 0) {
+                auto extra = starts.size() / 8 + 16;
+                Work += starts.size() - edited.LineGap;
+                Widen(starts, edited.LineGap, extra);
+                edited.LineGapSize += extra;
+            }
+            starts[edited.LineGap++] = static_cast<std::uint32_t>(nl + 1);
+            edited.LineGapSize--;
+            Work++;
+        }
+        edited.LineShift += static_cast<std::uint32_t>(replacement.length() - length);
+
+        edited.Whole = make_shared<EditedSource::Joined>();
+    }
+
+    void TokenStream::Splice(std::size_t first, std::size_t last, TokenStream const& part, std::size_t part_offset,
+        std::int64_t offset_delta) {
+        MoveGap(last);
+
+        // The replaced tokens are just in front of the gap, their values and texts are left to the new ones
+        for(size_t idx = first; idx < last; idx++) {
+            switch(KindOf(Types[idx])) {
+            case PayloadKind::Value:
+                FreeValues.push_back(Payloads[idx]);
+                break;
+            case PayloadKind::Text:
+                FreeTexts.push_back(Payloads[idx]);
+                break;
+            default:
+                break;
+            }
+        }
+        GapSize += last - first;
+        Gap = first;
+        WidenGap(part.size());
+
+        for(size_t idx = 0; idx < part.size(); idx++) {
+            auto type = part.Type(idx);
+            auto payload = part.Payloads[part.At(idx)];
+            switch(KindOf(type)) {
+            case PayloadKind::Value:
+                payload = Place(Values, FreeValues, part.Values[payload]);
+                break;
+            case PayloadKind::Text: {
+                auto span = part.Texts[payload];
+                span.Offset += part.ShiftOf(idx) + static_cast<std::uint32_t>(part_offset);
+                payload = Place(Texts, FreeTexts, span);
+                break;
+            }
+            default:
+                break;
+            }
+
+            // The gap is after the new tokens, so their offsets are stored as they are
+            Types[Gap] = type;
+            Offsets[Gap] = part.Offset(idx) + static_cast<std::uint32_t>(part_offset);
+            Lengths[Gap] = part.Length(idx);
+            Payloads[Gap] = payload;
+            Gap++;
+            GapSize--;
+        }
+
+        // Unsigned wrap-around does the subtraction
+        Shift += static_cast<std::uint32_t>(offset_delta);
+        Work += (last - first) + part.size();
+    }
+
+    void TokenStream::MoveGap(std::size_t idx) {
+        if(GapSize == 0 && Shift == 0) {
+            Gap = idx;
+            return;
+        }
+
+        // The tokens the gap moves over switch between stored and shifted offsets
+        auto move = [&](size_t from, size_t to, std::uint32_t shift) {
+            Types[to] = Types[from];
+            Offsets[to] = Offsets[from] + shift;
+            Lengths[to] = Lengths[from];
+            Payloads[to] = Payloads[from];
+            if(KindOf(Types[to]) == PayloadKind::Text) {
+                Texts[Payloads[to]].Offset += shift;
+            }
+            Work++;
+        };
+
+        for(; Gap > idx; Gap--) {
+            move(Gap - 1, Gap - 1 + GapSize, 0u - Shift);
+        }
+        for(; Gap < idx; Gap++) {
+            move(Gap + GapSize, Gap, Shift);
+        }
+    }
+
+    void TokenStream::WidenGap(std::size_t count) {
+        if(GapSize >= count) {
+            return;
+        }
+
+        // An eighth of the stream besides, so widening again takes many edits
+        auto extra = count - GapSize + size() / 8 + 16;
+        Work += size() - Gap;
+        Widen(Types, Gap, extra);
+        Widen(Offsets, Gap, extra);
+        Widen(Lengths, Gap, extra);
+        Widen(Payloads, Gap, extra);
+        GapSize += extra;
+    }
+
+    TokenPtr TokenStream::ToToken(std::size_t idx) const {
+        auto loc = Location(idx);
+        auto line = Line(idx);
+        size_t length = Length(idx);
+        auto text = [&]() { return string(Text(idx)); };
+
+        switch(Type(idx)) {
+        case TokenType::NEWLINE:
+            return make_shared<NEWLINE>(loc, line);
+        case TokenType::COLON:
+            return make_shared<COLON>(loc, line);
+        case TokenType::SEMICOLON:
+            return make_shared<SEMICOLON>(loc, line);
+        case TokenType::COMMA:
+            return make_shared<COMMA>(loc, line);
+        case TokenType::LEFT_BRACKET:
+            return make_shared<LEFT_BRACKET>(loc, line);
+        case TokenType::RIGHT_BRACKET:
+            return make_shared<RIGHT_BRACKET>(loc, line);
+        case TokenType::XPLUS:
+            return make_shared<XPLUS>(loc, line);
+        case TokenType::XMINUS:
+            return make_shared<XMINUS>(loc, line);
+        case TokenType::YPLUS:
+            return make_shared<YPLUS>(loc, line);
+        case TokenType::YMINUS:
+            return make_shared<YMINUS>(loc, line);
+        case TokenType::MNEMONIC:
+            return make_shared<MNEMONIC>(loc, line, GetOpcode(idx));
+        case TokenType::WORD_SIZE:
+            return make_shared<WORD_SIZE>(loc, line, text());
+        case TokenType::REGISTER:
+            return make_shared<REGISTER>(loc, line, text());
+        case TokenType::IDENTIFIER:
+            return make_shared<IDENTIFIER>(loc, line, text());
+        case TokenType::LABEL:
+            return make_shared<LABEL>(loc, line, text(), length);
+        case TokenType::COMMENT:
+            return make_shared<COMMENT>(loc, line, text());
+        case TokenType::BINARY_LITERAL:
+            return make_shared<BINARY_LITERAL>(loc, line, Value(idx), length);
+        case TokenType::OCTAL_LITERAL:
+            return make_shared<OCTAL_LITERAL>(loc, line, Value(idx), length);
+        case TokenType::DECIMAL_LITERAL:
+            return make_shared<DECIMAL_LITERAL>(loc, line, Value(idx), length);
+        case TokenType::HEX_LITERAL:
+            return make_shared<HEX_LITERAL>(loc, line, Value(idx), length);
+        case TokenType::CHAR_LITERAL:
+            return make_shared<CHAR_LITERAL>(loc, line, static_cast<char>(Value(idx)), length);
+        default:
+            return nullptr;
+        }
+    }
+
+    std::string TokenStream::ToString(std::size_t idx) const {
+        auto tok = ToToken(idx);
+        return (tok != nullptr) ? tok->ToString() : "";
+    }
+
+    std::string ToString(TokenStream const& tokens) {
+        std::string ret = "";
+
+        for(size_t idx = 0; idx < tokens.size(); idx++) {
+            ret += tokens.ToString(idx);
+        }
+
+        return ret;
+    }
+
+}